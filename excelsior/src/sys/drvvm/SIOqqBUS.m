@@ -93,6 +93,54 @@ BEGIN
   END
 END write;
 
+(* Kronos3vm (vm_cout): the line output is a ring the VM empties on
+   one sys_cout instead of an inp/out pair per character *)
+
+CONST RING = 1024;
+
+VAR vm_cout: BOOLEAN;
+       ring: RECORD
+               head,tail,size: INTEGER;
+               buf: ARRAY [0..RING-1] OF CHAR
+             END;
+
+PROCEDURE _vers(): INTEGER; CODE cod.sys cod.sys_vers END _vers;
+PROCEDURE _vm(): BITSET;    CODE cod.sys cod.sys_vm   END _vm;
+
+PROCEDURE cout(csr: INTEGER; r: SYSTEM.ADDRESS): INTEGER;
+CODE cod.sys cod.sys_cout END cout;
+
+PROCEDURE ring_put(ch: CHAR);
+  VAR h: INTEGER; m: BITSET;
+BEGIN
+  LOOP
+    m:=di();
+    h:=(ring.head+1) MOD RING;
+    IF h#ring.tail THEN
+      ring.buf[ring.head]:=ch; ring.head:=h; ei(m); RETURN
+    END;
+    ei(m);
+    IF cout(ocsr,SYSTEM.ADR(ring))=RING-1 THEN os.delay(1) END
+  END
+END ring_put;
+
+PROCEDURE write_ring(VAR r: req.REQUEST);
+  VAR s: str_ptr;  ch: CHAR;
+    p,l: INTEGER;
+BEGIN
+  l:=r.len; p:=r.pos; s:=r.buf;
+  WHILE l>0 DO
+    ch:=s^[p];
+    IF ch=NL THEN ring_put(15c); ch:=12c END;
+    IF ch >= 240c THEN
+       ch := koi2ansi[ORD(ch)];
+    END;
+    ring_put(ch); INC(p); DEC(l)
+  END;
+  WHILE cout(ocsr,SYSTEM.ADR(ring))>0 DO os.delay(1) END;
+  r.pos:=p
+END write_ring;
+
 PROCEDURE wait(VAR r: req.REQUEST);
   VAR i: INTEGER;
 BEGIN
@@ -134,7 +182,7 @@ BEGIN
   |req.READ     : read (r)
   |req.WAIT     : wait (r)
   |req.READY    : ready_no(r);
-  |req.WRITE    : write(r)
+  |req.WRITE    : IF vm_cout THEN write_ring(r) ELSE write(r) END
   |req.POWER_OFF:
   |req.GET_SPEC : get_spec(r)
   ELSE
@@ -224,6 +272,8 @@ BEGIN
   trap:=trap DIV 4 * 2;
   trap^:=kdrv; INC(trap); trap^:=SYSTEM.ADR(kipt);
   out(ocsr,000b);
+  vm_cout:=(_vers()=2) & (_vm()*cod.vm_cout#{});
+  ring.head:=0; ring.tail:=0; ring.size:=RING;
   ei(m);
   RETURN err.ok
 END init;
@@ -245,6 +295,15 @@ BEGIN
   IF on THEN on_off:=xon ELSE on_off:=NULL END
 END x_inp;
 
+PROCEDURE inpw(reg: INTEGER): INTEGER; CODE cod.inp END inpw;
+
+PROCEDURE winsize(VAR columns,lines: INTEGER);
+  VAR ws: INTEGER;
+BEGIN
+  ws:=inpw(odtr); (* VM: cols+rows*10000h, hardware: 0 *)
+  columns:=ws MOD 10000h; lines:=ws DIV 10000h
+END winsize;
+
 PROCEDURE self(): PROCESS; CODE cod.activ END self;
 
 PROCEDURE monitor(mon: PROC);
@@ -24,6 +24,13 @@ BEGIN
   IF kstate.breakon#0 THEN kstate.ubrk(n) END
 END break;
 
+PROCEDURE resize;
+  VAR c,l: INTEGER;
+BEGIN
+  sio.winsize(c,l);
+  IF (c>0) & (l>0) THEN tstate.columns:=c; tstate.lines:=l END
+END resize;
+
 PROCEDURE tt_reset;
 
   PROCEDURE set(VAR d: ARRAY OF CHAR; VAL s: ARRAY OF CHAR);
@@ -50,6 +57,7 @@ BEGIN
     screens  :=01;       cinter:=1;
 (*OTHERS := 0 *)
   END;
+  resize
 END tt_reset;
 
 PROCEDURE vt52(no: INTEGER; VAL x: ARRAY OF SYSTEM.WORD): INTEGER;
@@ -171,7 +179,7 @@ BEGIN
   WITH tstate DO
     CASE no OF
       |dtt._info         : IF i<=0 THEN RETURN err.bad_parm END;
-                           adr:=i; tptrptr:=adr; tptrptr^:=SYSTEM.ADR(tstate);
+                           resize; adr:=i; tptrptr:=adr; tptrptr^:=SYSTEM.ADR(tstate);
                            RETURN ok
       |dtt._reset        : tt_reset; RETURN ok
       |dtt._restore      : IF i<=0 THEN RETURN err.bad_parm END;
@@ -191,7 +199,8 @@ BEGIN
       |dtt._erase_chars  : str:=""33c"["; len:=2; app1("X")
       |dtt._set_pos      : str:=""33c"["; len:=2; app2(i0+1,i1+1,"H")
 
-      |dtt._roll_up      : str:="" 33c '[50;1H' 12c; len:=8;
+      |dtt._roll_up      : str:="" 33c '['; len:=2; app(tstate.lines,"H");
+                           str[len]:=12c; INC(len)
       |dtt._roll_down    : str:="" 33c '[1T'; len:=4;
 
 --    |dtt._scroll_up    : str:=""33c"7"233c"24H"205c 33c"8"; len:=9
@@ -43,6 +43,7 @@ CONST
 
 VAR lineFF,line00: ADDRESS;
     bumpFF,bump00: ARRAY [0..maxW DIV 32-1] OF WORD;
+               vm: BITSET;  (* Kronos3vm extensions *)
 
 PROCEDURE move(dest,sou: ADDRESS; size: INTEGER);
 CODE cod.move END move;
@@ -60,6 +61,13 @@ CODE cod.bmv END bmv;
 PROCEDURE dch(m: INTEGER; bmd: BITMAP; x,y: INTEGER; f: FONT; ch: CHAR);
 CODE cod.bmg cod.bmg_dch END dch;
 
+PROCEDURE dstr(m: INTEGER; bmd: BITMAP; x,y: INTEGER; f: FONT;
+               VAL s: ARRAY OF CHAR; p,l: INTEGER);
+CODE cod.bmg cod.bmg_dstr END dstr;
+
+PROCEDURE _vers(): INTEGER; CODE cod.sys cod.sys_vers END _vers;
+PROCEDURE _vm(): BITSET;    CODE cod.sys cod.sys_vm   END _vm;
+
 PROCEDURE in_rect(x,y,w,h: INTEGER): BOOLEAN;
 CODE
   cod.li1 cod.sub cod.swap
@@ -1477,8 +1485,10 @@ PROCEDURE xwrite(B: BITMAP;  VAL t: TOOL;          x,y: INTEGER;
   VAR ch: CHAR;               P: BOOLEAN;
      lay: ADDRESS;        px,pw: dfn.BTPTR;
    X,F,G: FONT;        XD,FD,GD: dfn.FNTD;
+       R: FONT;              RD: dfn.FNTD;
 bH,tH,x1: INTEGER;   bump,m,c,b: BITSET;
     dx,w: INTEGER;   ln,beg,end: INTEGER;
+     i,n: INTEGER;
 
 BEGIN
   DEC(y,f^.bline);
@@ -1502,6 +1512,35 @@ BEGIN
   G^.H:=F^.H;
   X^.H:=F^.H;
 
+  (* glyph run: whole chars of fixed font inside clip in one bmg per layer *)
+  IF (vm*cod.vm_dstr#{}) & NOT P & (f^.W<32) & (x>=t.clip.x) THEN
+    n:=(t.clip.x+t.clip.w-x) DIV f^.W;
+    IF n>l THEN n:=l END;
+    i:=0;
+    WHILE (i<n) & (s[p+i]>=f^.fchar) & (s[p+i]<=f^.lchar) DO INC(i) END;
+    n:=i;
+    IF n>0 THEN
+      R:=ADR(RD);  R^.W:=f^.W;  R^.H:=F^.H;  R^.rfe:=f^.H;
+      R^.BASE:=f^.BASE-ORD(f^.fchar)*f^.H+tH;
+      G^.W:=f^.W;  G^.rfe:=0;
+      m:=t.mask*B^.mask;     c:=t.color<<1;   b:=t.back;
+      lay:=ADR(B^.layers);   x1:=x+t.zX;
+      REPEAT
+        IF m*{0}#{} THEN
+          m:=m-{0}; B^.BASE:=lay^;
+          CASE INTEGER(c*{1})+INTEGER(b*{0}) OF
+          |0: dstr(t.mode  ,B,x1,y,G,s,p,n)
+          |1: dstr(t.mode+4,B,x1,y,R,s,p,n)
+          |2: dstr(t.mode  ,B,x1,y,R,s,p,n)
+          |3: dstr(t.mode+4,B,x1,y,G,s,p,n)
+          END
+        END;
+        b:=b>>1; c:=c>>1; INC(lay); m:=m>>1
+      UNTIL m={};
+      x:=x+n*f^.W;  p:=p+n;  l:=l-n
+    END
+  END;
+
   WHILE (l>0) & (x<t.clip.x+t.clip.w) DO
     ch:=s[p];
     IF  P   THEN dx:=ORD(pw^[ch]); w:=f^.W ELSE dx:=f^.W; w:=dx END;
@@ -1677,5 +1716,6 @@ CONST h=HIGH(bump00);
 BEGIN
   lineFF:=ADR(bumpFF);   bumpFF[0]:=-1;  move(lineFF+1,lineFF,h);
   line00:=ADR(bump00);   bump00[0]:= 0;  move(line00+1,line00,h);
-  lineXX:=ADR(bumpXX)
+  lineXX:=ADR(bumpXX);
+  IF _vers()=2 THEN vm:=_vm() ELSE vm:={} END
 END BMG.
@@ -135,8 +135,17 @@ END chk;
 
 VAR _to_os: BOOLEAN;
 
+VAR vm_heap: BOOLEAN; -- Kronos3vm walks the ring
+
+PROCEDURE _vers(): INTEGER; CODE cmd.sys cmd.sys_vers END _vers;
+PROCEDURE _vm(): BITSET;    CODE cmd.sys cmd.sys_vm   END _vm;
+
+PROCEDURE vm_ring(p: list; w: int): list;
+CODE cmd.sys cmd.sys_ring END vm_ring;
+
 PROCEDURE try_ring(VAR p: list; w: int): BOOLEAN;
 BEGIN
+  IF vm_heap THEN p:=vm_ring(curr,w); RETURN p#NIL END;
   p:=curr;
   LOOP IF p^.size>=w THEN RETURN TRUE END;
        p:=p^.next;
@@ -149,18 +158,17 @@ PROCEDURE alloc_large(VAR a: adr; w: int);
       s: POINTER TO int;
       new: slot;
 BEGIN
-  p:=curr;
-  LOOP IF p^.size>=w THEN EXIT END;
-       p:=p^.next;
-       IF p=curr THEN
-           add_slot(new,w);
-           IF new=NIL THEN
-               IF NOT user_collectors() THEN a:=NIL; RETURN END;
-               IF try_ring(p,w) THEN EXIT END;
+  IF NOT try_ring(p,w) THEN
+       add_slot(new,w);
+       IF new=NIL THEN
+           IF NOT user_collectors() THEN a:=NIL; RETURN END;
+           IF NOT try_ring(p,w) THEN
                IF flush_ring(0) THEN END;
                add_slot(new,w);
                IF new=NIL THEN a:=NIL; RETURN END;
            END;
+       END;
+       IF new#NIL THEN
            p:=list(int(new)+SIZE(scrap)+1);
            p^.size:=new^.size-4; set_end(p);
            s:=adr(p)-1;         s^:=marked(0);
@@ -168,7 +176,6 @@ BEGIN
            r:=FB^.next;
            p^.prev:=FB; p^.next:=r; FB^.next:=p; r^.prev:=p;
            curr:=p;
-           EXIT
        END;
   END;
   IF (p^.size-w) < minsize THEN -- whole block
@@ -444,6 +451,7 @@ BEGIN
   ASSERT(NOT (hbit IN bit(NIL)));
   ASSERT(minsize<=010h);
   done:=TRUE; error:=0;
+  vm_heap:=(_vers()=2) & (_vm()*cmd.vm_heap#{});
 
   pool:=NIL;
   FOR i:=0 TO HIGH(gcs) DO gcs[i]:=NULL END;
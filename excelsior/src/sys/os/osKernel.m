@@ -1036,12 +1036,25 @@ VAR
 
 ----------------------------------------------------------------
 
+VAR vm_heap: BOOLEAN; -- Kronos3vm walks the lists, see ini_memory
+
+PROCEDURE _vers(): INTEGER; CODE cod.sys cod.sys_vers END _vers;
+PROCEDURE _vm(): BITSET;    CODE cod.sys cod.sys_vm   END _vm;
+
+PROCEDURE vm_alloc(VAR head: slice_ptr; min: INTEGER;
+                   VAR a: ADDRESS; VAR w: INTEGER);
+CODE cod.sys cod.sys_alloc END vm_alloc;
+
+PROCEDURE vm_dealloc(VAR head: slice_ptr; a: ADDRESS; w: INTEGER);
+CODE cod.sys cod.sys_dealloc END vm_dealloc;
+
 PROCEDURE _alloc(VAR head: slice_ptr;
                       min: INTEGER;
                  VAR a   : ADDRESS;
                  VAR w   : INTEGER);
   VAR l,p,n: slice_ptr;
 BEGIN
+  IF vm_heap THEN vm_alloc(head,min,a,w); RETURN END;
   l:=head; p:=NIL;
   WHILE (l#NIL) & (l^.size<w) DO p:=l; l:=l^.next END;
   IF l=NIL THEN a:=NIL; RETURN END;
@@ -1059,7 +1072,9 @@ END _alloc;
 
 PROCEDURE _dealloc(VAR head: slice_ptr; a: ADDRESS; w: INTEGER);
   VAR l,p,n: slice_ptr;
-BEGIN n:=a; n^.size:=w;
+BEGIN
+  IF vm_heap THEN vm_dealloc(head,a,w); RETURN END;
+  n:=a; n^.size:=w;
   l:=head; p:=NIL;
   WHILE (l#NIL) & (l<a) DO p:=l; l:=l^.next END;
   n^.next:=l;
@@ -1330,6 +1345,7 @@ PROCEDURE ini_memory;
    size: INTEGER;
 
 BEGIN
+  vm_heap:=(_vers()=2) & (_vm()*cod.vm_heap#{});
   a:=88h; memtop:=a^;
   a:=85h; a:=a^; size:=memtop-a+1;
   ini_mutex(mem_lock);
@@ -0,0 +1,145 @@
+MODULE hostcp; (*  19-Oct-26. (c) KRONOS *)
+
+(* copy files between Kronos3vm host directory (-host:dir) and Kronos *)
+
+IMPORT  SYSTEM;
+IMPORT  cod: defCodes;
+IMPORT  err: defErrors;
+IMPORT  bio: BIO;
+IMPORT  std: StdIO;
+IMPORT  tty: Terminal;
+IMPORT  str: Strings;
+IMPORT args: tskArgs;
+
+PROCEDURE _vers(): INTEGER; CODE cod.sys cod.sys_vers END _vers;
+PROCEDURE _vm(): BITSET;    CODE cod.sys cod.sys_vm   END _vm;
+
+PROCEDURE host(op,h: INTEGER; adr: SYSTEM.ADDRESS; len: INTEGER): INTEGER;
+CODE cod.io4 END host;
+
+VAR buf: ARRAY [0..16*1024-1] OF INTEGER; (* 64K per io4 *)
+      h: INTEGER;                           (* open host handle or -1 *)
+
+(* HOSTFS has a few handles for the whole VM session: give it back
+   before any HALT *)
+
+PROCEDURE hclose;
+  VAR res: INTEGER;
+BEGIN
+  IF h>=0 THEN res:=host(cod.host_close,h,SYSTEM.ADR(buf),0); h:=-1 END
+END hclose;
+
+PROCEDURE herr(res: INTEGER; VAL name: ARRAY OF CHAR);
+BEGIN
+  hclose;
+  tty.print('hostcp: "%s" host error %d\n',name,-res); HALT(err.io_error)
+END herr;
+
+PROCEDURE check(VAL name: ARRAY OF CHAR);
+BEGIN
+  IF bio.done THEN RETURN END;
+  hclose;
+  tty.perror(bio.error,'hostcp: "%s" %%s\n',name); HALT(bio.error)
+END check;
+
+PROCEDURE tail(VAL path: ARRAY OF CHAR; VAR name: ARRAY OF CHAR);
+  VAR i,j: INTEGER;
+BEGIN
+  i:=0; j:=0;
+  WHILE (i<=HIGH(path)) & (path[i]#0c) DO
+    IF (path[i]='/') OR (path[i]='\') THEN j:=i+1 END; INC(i)
+  END;
+  i:=0;
+  WHILE (j<=HIGH(path)) & (path[j]#0c) DO
+    IF i>=HIGH(name) THEN
+      hclose;
+      tty.print('hostcp: "%s" name longer than %d\n',path,HIGH(name));
+      HALT(err.bad_name)
+    END;
+    name[i]:=path[j]; INC(i); INC(j)
+  END;
+  name[i]:=0c
+END tail;
+
+PROCEDURE get(VAL name: ARRAY OF CHAR);
+  VAR f: bio.FILE; n,size: INTEGER; to: ARRAY [0..31] OF CHAR;
+BEGIN
+  tail(name,to);
+  h:=host(cod.host_open,0,SYSTEM.ADR(name),str.len(name));
+  IF h<0 THEN herr(h,name) END;
+  size:=host(cod.host_size,h,SYSTEM.ADR(buf),0);
+  IF size<0 THEN herr(size,name) END;
+  bio.create(f,to,'w',size);                             check(to);
+  LOOP
+    n:=host(cod.host_read,h,SYSTEM.ADR(buf),BYTES(buf));
+    IF n<0 THEN herr(n,name) END;
+    IF n=0 THEN EXIT END;
+    bio.write(f,SYSTEM.ADR(buf),n);                      check(to)
+  END;
+  bio.close(f);                                          check(to);
+  hclose;
+  std.print("%s %d\n",to,size)
+END get;
+
+PROCEDURE put(VAL name: ARRAY OF CHAR);
+  VAR f: bio.FILE; n,len,size: INTEGER; to: ARRAY [0..31] OF CHAR;
+BEGIN
+  tail(name,to);
+  bio.open(f,name,'r');                                  check(name);
+  size:=bio.eof(f);                                      check(name);
+  h:=host(cod.host_open,1,SYSTEM.ADR(to),str.len(to));
+  IF h<0 THEN herr(h,to) END;
+  len:=size;
+  WHILE len>0 DO
+    IF len>BYTES(buf) THEN n:=BYTES(buf) ELSE n:=len END;
+    bio.read(f,SYSTEM.ADR(buf),n);                       check(name);
+    IF host(cod.host_write,h,SYSTEM.ADR(buf),n)#n THEN herr(-1,to) END;
+    DEC(len,n)
+  END;
+  bio.close(f);                                          check(name);
+  hclose;
+  std.print("%s %d\n",to,size)
+END put;
+
+PROCEDURE list(VAL patt: ARRAY OF CHAR);
+  VAR n: INTEGER; name: ARRAY [0..255] OF CHAR;
+BEGIN
+  h:=host(cod.host_opendir,0,SYSTEM.ADR(patt),str.len(patt));
+  IF h<0 THEN herr(h,patt) END;
+  LOOP
+    n:=host(cod.host_readdir,h,SYSTEM.ADR(name),BYTES(name));
+    IF n<0 THEN herr(n,patt) END;
+    IF n=0 THEN EXIT END;
+    IF n>=BYTES(name) THEN name[HIGH(name)]:=0c END;
+    std.print("%s\n",name)
+  END;
+  hclose
+END list;
+
+PROCEDURE help;
+BEGIN
+  std.print('    "hostcp"  copy files from/to Kronos3vm host     (c) KRONOS\n'
+            'usage:\n'
+            '     hostcp {host_file}       copy to current directory\n'
+            '     hostcp -p {file}         copy to host directory\n'
+            '     hostcp -l [pattern]      list host directory\n');
+END help;
+
+VAR i: INTEGER;
+
+BEGIN
+  h:=-1;
+  IF args.flag('-','h') THEN help; HALT END;
+  IF (_vers()#2) OR (_vm()*cod.vm_host={}) THEN
+    std.print('hostcp: no host directory (Kronos3vm -host:dir)\n');
+    HALT(err.not_ready)
+  END;
+  IF args.flag('-','l') THEN
+    IF HIGH(args.words)<0 THEN list("") ELSE list(args.words[0]) END
+  ELSIF HIGH(args.words)<0 THEN help
+  ELSIF args.flag('-','p') THEN
+    FOR i:=0 TO HIGH(args.words) DO put(args.words[i]) END
+  ELSE
+    FOR i:=0 TO HIGH(args.words) DO get(args.words[i]) END
+  END
+END hostcp.
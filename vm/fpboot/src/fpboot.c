@@ -0,0 +1,511 @@
+﻿/*
+* FPBOOT - boot images of the real arithmetic tests (c) KRONOS
+*
+* Purpose: builds the -boot images vm/run-tests.bat runs from vm/tests:
+*
+*   fptest.boot   the vectors of vm/vhdl/5.0/tests/fptest.txt (IEEE single
+*                 results of the 5.0 FPU): fast reals must reproduce them
+*   fpstrict.boot vectors of -reals:strict: rounding ties, overflow,
+*                 underflow, division by zero, TRUNC and FLOAT limits and
+*                 random operands, the results from an integer model of the
+*                 Kronos format below (not from the VM's double arithmetic)
+*   fpbench.boot  a loop of real operations, timed with -reals:strict and
+*                 -reals:fast
+*   krest.boot    excelsior/src/boot/krest.boot patched to run on Kronos3vm
+*                 and print to the console (see krest below)
+*
+* fptest.txt is a loader stream for the 5.0 board monitor: one 110K code
+* segment of LIW/SGW runs storing x, y and the 12 expected results in
+* globals 2..15, each followed by a call of the check procedure.  Kronos3vm
+* returns to 16-bit PCs (RTN), so the runs are turned into a table the
+* image walks; the check procedure is copied as is, except that a failed
+* check quits with its number + 1 instead of printing the operands only.
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+enum {
+	imgP     = 0x08,	/* process descriptor: G L PC M S H */
+	imgG     = 0x10,	/* globals, G+16 - the table pointer */
+	imgL     = 0x30,	/* L, S = L + 1 (no saved A-stack) */
+	imgH     = 0x70,
+	imgF     = 0x80,	/* code: F+0 main, F+1 check, bytes from F+2 */
+	maxWords = 0x10000,
+	checks   = 12,
+	recWords = 14		/* x y and the 12 results */
+};
+
+static uint32_t img[maxWords];
+static uint8_t* code = (uint8_t*)&img[imgF];
+static int      pc;	/* bytes of code */
+
+static uint32_t src[maxWords];
+static int      srcWords;
+
+void usage(void)
+{
+	printf("fpboot - boot images of the real arithmetic tests\n"
+		"Usage:\n"
+		"\tfpboot fptest.txt dir [krest.boot]\n"
+		"\t\t- writes dir/fptest.boot, fpstrict.boot, fpbench.boot and krest.boot\n");
+	exit(1);
+}
+
+void fail(const char* msg)
+{
+	printf("ERROR: %s\n", msg);
+	exit(1);
+}
+
+void b(int x) { code[pc++] = (uint8_t)x; }
+
+void w(uint32_t x) { b(0x12); b(x); b(x >> 8); b(x >> 16); b(x >> 24); }	/* LIW */
+
+void start(void)
+{
+	memset(img, 0, sizeof(img));
+	img[1]        = imgP;
+	img[imgP + 0] = imgG;
+	img[imgP + 1] = imgL;
+	img[imgP + 2] = 8;
+	img[imgP + 3] = 0;	/* all interrupts masked: no timer, no traps wanted */
+	img[imgP + 4] = imgL + 1;
+	img[imgP + 5] = imgH;
+	img[imgG]     = imgF;
+	img[imgF]     = 8;
+	pc = 8;
+}
+
+void save(const char* dir, const char* name, int words)
+{
+	char path[1024];
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	FILE* f = fopen(path, "wb");
+	if (f == NULL || fwrite(img, 4, words, f) != (size_t)words || fclose(f) != 0)
+		fail("cannot write the image");
+	printf("%s: %d words\n", path, words);
+}
+
+/* "<adr>l<word>" CR "l<word>" CR ... as sent to the monitor */
+void load(const char* name)
+{
+	FILE* f = fopen(name, "rb");
+	if (f == NULL)
+		fail("cannot open the test vectors");
+	int ch, digits = 0;
+	uint32_t x = 0;
+	while ((ch = fgetc(f)) != EOF) {
+		if (ch >= '0' && ch <= '9') { x = x << 4 | (ch - '0'); digits++; }
+		else if (ch >= 'a' && ch <= 'f') { x = x << 4 | (ch - 'a' + 10); digits++; }
+		else if (ch == 'l') { x = 0; digits = 0; }
+		else if ((ch == '\r' || ch == '\n') && digits > 0) {
+			if (srcWords == maxWords)
+				fail("too many words");
+			src[srcWords++] = x;
+			x = 0;
+			digits = 0;
+		}
+	}
+	if (digits > 0 && srcWords < maxWords)
+		src[srcWords++] = x;
+	fclose(f);
+}
+
+void fptest(const char* dir)
+{
+	const uint8_t* s = (const uint8_t*)src;
+	int size = srcWords * 4;
+	int check = (int)src[1];
+	if (srcWords < 2 || s[2] != 0x1B || s[3] != 4 || check <= 8 || check >= size)
+		fail("not the fptest.txt code segment");
+
+	/* the records: LIW x SGW 2 ... LIW r SGW 15 CL 1 */
+	start();
+	int recs = 0;
+	int table = imgF + 0x100;
+	int at = 8;
+	while (at + recWords * 6 < check && s[at] == 0x12) {
+		for (int k = 0; k < recWords; k++) {
+			if (s[at + k * 6] != 0x12 || s[at + k * 6 + 5] != 0x52 + k)
+				fail("unexpected code in the test runs");
+			memcpy(&img[table + recs * recWords + k], s + at + k * 6 + 1, 4);
+		}
+		at += recWords * 6;
+		if (s[at++] != 0xD1)
+			fail("a test run without CL 1");
+		recs++;
+	}
+	if (recs == 0 || s[at] != 0x81)
+		fail("no test runs");
+	int end = table + recs * recWords;
+	if (end > maxWords)
+		fail("too many records");
+
+	w(table); b(0x31); b(0x10);			/* g16 := table */
+	int loop = pc;
+	for (int k = 0; k < recWords; k++) {
+		b(0x21); b(0x10); b(0x23); b(k); b(0x52 + k);	/* g(k+2) := g16^[k] */
+	}
+	b(0xD1);					/* CL 1 */
+	b(0x21); b(0x10); b(0x10); b(recWords); b(0x88); b(0x31); b(0x10);
+	b(0x21); b(0x10); w(end); b(0xA4);		/* g16 = end */
+	b(0x1E); b(pc + 1 - loop);			/* JBSC loop */
+	b(0x00); b(0x53); b(0x81);			/* quit 0 */
+
+	/* the check procedure, each "NEQ JFSC n LI i OUT ... QUIT" block
+	   becomes "NEQ JFSC n ... LI i+1 SGW 3 QUIT" */
+	img[imgF + 1] = pc;
+	int len = size - check;
+	if (pc + len > (table - imgF) * 4)
+		fail("the check procedure is too long");
+	memcpy(code + pc, s + check, len);
+	int fixed = 0;
+	for (int p = pc; p + 3 < pc + len; p++) {
+		uint8_t* q = code + p;
+		int n = q[2];
+		if (q[0] == 0xA5 && q[1] == 0x1A && n >= 5 && p + 3 + n <= pc + len &&
+			q[3] < checks && q[4] == 0xFE && q[2 + n] == 0x81) {
+			int i = q[3];
+			memmove(q + 3, q + 5, n - 3);
+			q[n] = i + 1;
+			q[n + 1] = 0x53;
+			q[n + 2] = 0x81;
+			fixed++;
+		}
+	}
+	if (fixed != checks)
+		fail("unexpected check procedure");
+	printf("fptest: %d vectors\n", recs);
+	save(dir, "fptest.boot", end);
+}
+
+/* Kronos reals: sign, 8 bit exponent biased by 127, 23 bit fraction with
+   a hidden 1.  Exponent 0 is zero whatever the fraction, 255 is an
+   ordinary number.  Results are the exact value rounded half away from
+   zero to 24 bits; overflow and division by zero give 0 and trap 42h,
+   underflow gives 0 and traps 43h except for FADD and FSUB, TRUNC outside
+   the integer range gives 0 and traps 41h. */
+
+enum { fAdd, fSub, fMul, fDiv, fFloat, fTrunc, fLss, fEqu, ops };
+
+static const uint8_t opCode[ops][2] = {
+	{ 0x98, 0xCB }, { 0x99, 0xCB }, { 0x9A, 0xCB }, { 0x9B, 0xCB },
+	{ 0x9F, 0x00 }, { 0x9F, 0x01 }, { 0x9C, 0xA0 }, { 0x9C, 0xA4 }
+};
+
+typedef struct { int sign; int e; uint64_t m; } Real;	/* m * 2^(e - 150) */
+
+static Real unpack(uint32_t x)
+{
+	Real r;
+	r.sign = x >> 31;
+	r.e = (x >> 23) & 0xFF;
+	r.m = r.e == 0 ? 0 : (x & 0x7FFFFF) | 0x800000;
+	return r;
+}
+
+/* m * 2^e, m the exact magnitude or its floor below the guard bit */
+static uint32_t pack(int sign, uint64_t m, int e, int trapUnder, int* trap)
+{
+	if (m == 0)
+		return 0;
+	int t = 63;
+	while ((m >> t) == 0)
+		t--;
+	uint64_t k = t >= 24 ? (m >> (t - 23)) + ((m >> (t - 24)) & 1) : m << (23 - t);
+	if (k == 0x1000000) {
+		k >>= 1;
+		t++;
+	}
+	int be = e + t + 127;
+	if (be > 255) {
+		*trap = 0x42;
+		return 0;
+	}
+	if (be <= 0) {
+		if (trapUnder)
+			*trap = 0x43;
+		return 0;
+	}
+	return (uint32_t)sign << 31 | (uint32_t)be << 23 | (uint32_t)(k & 0x7FFFFF);
+}
+
+static uint32_t addReal(uint32_t x, uint32_t y, int* trap)
+{
+	Real a = unpack(x), c = unpack(y);
+	if (a.m == 0) { a = c; c.m = 0; }
+	if (c.m != 0 && (c.e > a.e || (c.e == a.e && c.m > a.m))) {
+		Real t = a; a = c; c = t;
+	}
+	int d = a.e - c.e;
+	uint64_t ma = a.m << 32;
+	uint64_t mc = d >= 64 ? 0 : (c.m << 32) >> d;
+	int lost = d >= 64 ? c.m != 0 : d > 32 && ((c.m << 32) & ((1ULL << d) - 1)) != 0;
+	uint64_t m = a.sign == c.sign ? ma + mc : ma - mc - lost;
+	return pack(a.sign, m, a.e - 150 - 32, 0, trap);
+}
+
+static uint32_t model(int op, uint32_t x, uint32_t y, int* trap)
+{
+	Real a = unpack(x), c = unpack(y);
+	*trap = 0;
+	switch (op) {
+	case fAdd:
+		return addReal(x, y, trap);
+	case fSub:
+		return addReal(x, y ^ 0x80000000, trap);
+	case fMul:
+		if (a.m == 0 || c.m == 0)
+			return 0;
+		return pack(a.sign ^ c.sign, a.m * c.m, a.e + c.e - 300, 1, trap);
+	case fDiv:
+		if (c.m == 0) {
+			*trap = 0x42;
+			return 0;
+		}
+		if (a.m == 0)
+			return 0;
+		return pack(a.sign ^ c.sign, (a.m << 40) / c.m, a.e - c.e - 40, 1, trap);
+	case fFloat: {
+		int neg = (int32_t)x < 0;
+		return pack(neg, neg ? 0 - (uint64_t)(int32_t)x : x, 0, 1, trap);
+	}
+	case fTrunc:
+		if (a.m == 0)
+			return 0;
+		if (a.e >= 158) {	/* 2^31 and up */
+			*trap = 0x41;
+			return 0;
+		} else {
+			uint32_t v = a.e >= 150 ? (uint32_t)(a.m << (a.e - 150)) :
+				a.e > 150 - 64 ? (uint32_t)(a.m >> (150 - a.e)) : 0;
+			return a.sign ? 0 - v : v;
+		}
+	default: {
+		/* -1, 0, 1 as the values compare */
+		int sa = a.m == 0 ? 0 : a.sign ? -1 : 1;
+		int sc = c.m == 0 ? 0 : c.sign ? -1 : 1;
+		int cmp = sa != sc ? (sa < sc ? -1 : 1) :
+			sa == 0 || (a.e == c.e && a.m == c.m) ? 0 :
+			(a.e > c.e || (a.e == c.e && a.m > c.m)) == (sa > 0) ? 1 : -1;
+		return op == fLss ? cmp < 0 : cmp == 0;
+	}
+	}
+}
+
+static uint32_t seed = 0x4B524F4E;
+
+static uint32_t rnd(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+static uint32_t real(int sign, int e, uint32_t f)
+{
+	return (uint32_t)sign << 31 | (uint32_t)(e & 0xFF) << 23 | (f & 0x7FFFFF);
+}
+
+/* operands of the directed cases, each tried with every operation */
+static const uint32_t directed[][2] = {
+	{ 0x3F800000, 0x33800000 },	/* 1 + 2^-24: a tie */
+	{ 0xBF800000, 0xB3800000 },
+	{ 0x3F800000, 0x33000000 },	/* 1 - 2^-25: a tie below 1 */
+	{ 0x3F800001, 0x3FC00000 },	/* (1 + 2^-23) * 1.5: a tie */
+	{ 0x3F800003, 0x33800000 },
+	{ 0x3FFFFFFF, 0x3F800000 },
+	{ 0x7FFFFFFF, 0x7FFFFFFF },	/* exponent 255, overflow */
+	{ 0x7F800000, 0x40000000 },
+	{ 0x7F000000, 0x3E800000 },
+	{ 0x00800000, 0x00800000 },	/* smallest, underflow */
+	{ 0x00800001, 0x00800000 },
+	{ 0x00800000, 0x7F000000 },
+	{ 0x01000000, 0x3F000000 },
+	{ 0x3F800000, 0x00000000 },	/* division by zero */
+	{ 0x3F800000, 0x00000001 },	/* exponent 0 is zero */
+	{ 0x00000001, 0x3F800000 },
+	{ 0x4F000000, 0x00000000 },	/* TRUNC 2^31 */
+	{ 0xCF000000, 0x00000000 },	/* TRUNC -2^31 */
+	{ 0x4EFFFFFF, 0x00000000 },
+	{ 0xCEFFFFFF, 0x00000000 },
+	{ 0x3F7FFFFF, 0x00000000 },
+	{ 0xBFC00000, 0x00000000 },
+	{ 0x7FFFFFFF, 0x00000000 },	/* FLOAT of MAX(INTEGER) */
+	{ 0x80000000, 0x00000000 },
+	{ 0x01000001, 0x00000000 },	/* FLOAT 2^24 + 1: a tie */
+	{ 0xFEFFFFFF, 0x00000000 },
+	{ 0x00000000, 0x80000000 },	/* -0 */
+	{ 0x40400000, 0x40400000 }
+};
+
+enum { randoms = 500, strRecs = 4 };	/* x y result trap */
+
+static int record(int table, int n, int op, uint32_t x, uint32_t y)
+{
+	int trap = 0;
+	uint32_t* r = &img[table + n * strRecs];
+	r[0] = x;
+	r[1] = y;
+	r[2] = model(op, x, y, &trap);
+	r[3] = trap;
+	return n + 1;
+}
+
+void fpstrict(const char* dir)
+{
+	int table = imgF + 0x100;
+	int n = 0;
+	start();
+	for (int op = 0; op < ops; op++) {
+		int first = n;
+		for (size_t i = 0; i < sizeof(directed) / sizeof(directed[0]); i++)
+			n = record(table, n, op, directed[i][0], directed[i][1]);
+		for (int i = 0; i < randoms; i++) {
+			uint32_t x = rnd(), y = rnd();
+			int e = (x >> 23) & 0xFF;
+			switch (i % 4) {
+			case 0:	/* exponents close: cancellation, ties */
+				y = real(y >> 31, e - (int)(rnd() % 26), y);
+				break;
+			case 1:	/* low bits set for the guard bit */
+				y = real(y >> 31, e - 24, y | 1);
+				break;
+			case 2:	/* near the ends of the range */
+				x = real(x >> 31, rnd() % 2 ? 1 + rnd() % 8 : 247 + rnd() % 9, x);
+				break;
+			default:
+				break;
+			}
+			if (op == fTrunc && i % 2 == 0)
+				x = real(x >> 31, 127 + rnd() % 33, x);
+			if (op == fFloat && i % 2 == 0)
+				x = (int32_t)x >> (rnd() % 32);
+			n = record(table, n, op, x, y);
+		}
+		/* g16 := first record, g17 := its end */
+		w(table + first * strRecs); b(0x31); b(0x10);
+		w(table + n * strRecs);     b(0x31); b(0x11);
+		int loop = pc;
+		b(0x0E); b(0x00); b(0x33); b(0x00);		/* P^.ipt := 0 */
+		b(0x21); b(0x10); b(0x23); b(0x00);		/* x */
+		if (op != fFloat && op != fTrunc) {
+			b(0x21); b(0x10); b(0x23); b(0x01);	/* y */
+		}
+		b(opCode[op][0]); b(opCode[op][1]);
+		b(0x21); b(0x10); b(0x23); b(0x02); b(0xA5);	/* result # r[2] */
+		b(0x1A); b(7);
+		b(0x21); b(0x10); b(0xFE); b(0x10); b(op * 2 + 1); b(0x53); b(0x81);
+		b(0x0E); b(0x23); b(0x00);			/* P^.ipt # r[3] */
+		b(0x21); b(0x10); b(0x23); b(0x03); b(0xA5);
+		b(0x1A); b(7);
+		b(0x21); b(0x10); b(0xFE); b(0x10); b(op * 2 + 2); b(0x53); b(0x81);
+		b(0x21); b(0x10); b(strRecs); b(0x88); b(0x31); b(0x10);
+		b(0x21); b(0x10); b(0x21); b(0x11); b(0xA4);	/* g16 = g17 */
+		b(0x1E); b(pc + 1 - loop);			/* JBSC loop */
+	}
+	b(0x00); b(0x53); b(0x81);				/* quit 0 */
+	if (pc > (table - imgF) * 4)
+		fail("the strict test code is too long");
+	printf("fpstrict: %d vectors\n", n);
+	save(dir, "fpstrict.boot", table + n * strRecs);
+}
+
+/* x := x * 0.5 + 1.0 reaches 2.0 and y := (x - 0.5) / 3.0 then is 0.5,
+   exactly with strict and fast reals alike; quits 0 on x = 2.0 */
+void fpbench(const char* dir)
+{
+	static const uint8_t step[] = {
+		0x44, 0x45, 0x9A, 0x46, 0x98, 0x54,
+		0x44, 0x45, 0x99, 0x47, 0x9B, 0x58
+	};
+	start();
+	w(2000000);    b(0x52);	/* g2 - iterations */
+	w(0x3F800000); b(0x54);	/* g4 - x = 1.0, g8 - y */
+	w(0x3F000000); b(0x55);	/* 0.5 */
+	w(0x3F800000); b(0x56);	/* 1.0 */
+	w(0x40400000); b(0x57);	/* 3.0 */
+	int loop = pc;
+	for (int k = 0; k < 4; k++) {
+		memcpy(code + pc, step, sizeof(step));
+		pc += sizeof(step);
+	}
+	b(0x42); b(0x01); b(0x89); b(0x52);		/* g2 := g2 - 1 */
+	b(0x42); b(0x00); b(0xA4);			/* g2 = 0 */
+	b(0x1E); b(pc + 1 - loop);			/* JBSC loop */
+	b(0x44); w(0x40000000); b(0xA5); b(0x53); b(0x81);	/* quit x # 2.0 */
+	save(dir, "fpbench.boot", imgF + (pc + 3) / 4);
+}
+
+/* krest.boot is built for a Kronos 2.6 with an IGD480 display (see
+   excelsior/src/sys/test/krest.m); three places keep it from running on
+   the VM, each is checked against the bytes it replaces:
+   - enterTEST0 quits with 0BAD0h unless "sys 0" is 6, the VM says 7;
+   - init_palet waits for the line sync bit of 1F0020h, which IGD480.cpp
+     does not toggle: both JBSC become DROP NOP;
+   - writeIgd draws with BBLTG on the bitmap, which -capture: and -until:
+     do not see: after its ENTR and parameters it becomes
+       i:=0; WHILE (i<len) & (str[i]#0c) DO OUT(0FBBh,str[i]); INC(i) END
+     on the console data register. */
+
+typedef struct { int at; int len; uint8_t was[32]; uint8_t now[32]; } Patch;
+
+static const Patch krestPatch[] = {
+	{ 0x45C4, 4,
+	  { 0xFC, 0x00, 0x10, 0x06 },
+	  { 0xFC, 0x00, 0x10, 0x07 } },
+	{ 0x28F4, 15,
+	  { 0x21, 0xB9, 0x60, 0x01, 0xA9, 0xAE, 0x1E, 0x08,
+	    0x21, 0xB9, 0x60, 0x01, 0xA9, 0x1E, 0x07 },
+	  { 0x21, 0xB9, 0x60, 0x01, 0xA9, 0xAE, 0xB1, 0xCB,
+	    0x21, 0xB9, 0x60, 0x01, 0xA9, 0xB1, 0xCB } },
+	{ 0x29F1, 31,
+	  { 0xC9, 0x06, 0x34, 0x35, 0x36, 0xCF, 0x21, 0x00,
+	    0x37, 0x24, 0x25, 0xA2, 0x1A, 0x04, 0x25, 0x01,
+	    0x88, 0x34, 0x27, 0x24, 0xA0, 0x1A, 0x4D, 0x26,
+	    0x27, 0x40, 0x1A, 0x48, 0x26, 0x27, 0x40 },
+	  { 0xC9, 0x06, 0x34, 0x35, 0x36,	/* ENTR 6, len str HIGH */
+	    0x00, 0x37,				/* i:=0 */
+	    0x27, 0x24, 0xA0, 0x1A, 0x12,	/* i<len */
+	    0x26, 0x27, 0x40, 0x1A, 0x0D,	/* str[i]#0c */
+	    0x11, 0xBB, 0x0F, 0x26, 0x27, 0x40, 0x91,	/* OUT */
+	    0x27, 0x01, 0x88, 0x37,		/* INC(i) */
+	    0x1F, 0x17,				/* JBS */
+	    0xCA } },				/* RTN */
+};
+
+void krest(const char* name, const char* dir)
+{
+	memset(img, 0, sizeof(img));
+	FILE* f = fopen(name, "rb");
+	if (f == NULL)
+		fail("cannot open krest.boot");
+	int words = (int)fread(img, 4, maxWords, f);
+	fclose(f);
+	int n = sizeof(krestPatch) / sizeof(krestPatch[0]);
+	for (int k = 0; k < n; k++) {
+		const Patch* p = &krestPatch[k];
+		uint8_t* q = (uint8_t*)img + p->at;
+		if (p->at + p->len > words * 4 || memcmp(q, p->was, p->len) != 0)
+			fail("not the krest.boot of excelsior/src/boot");
+		memcpy(q, p->now, p->len);
+	}
+	save(dir, "krest.boot", words);
+}
+
+int main(int argc, char** argv)
+{
+	if (argc != 3 && argc != 4) usage();
+	load(argv[1]);
+	fptest(argv[2]);
+	fpstrict(argv[2]);
+	fpbench(argv[2]);
+	if (argc == 4)
+		krest(argv[3], argv[2]);
+	return 0;
+}
@@ -0,0 +1,135 @@
+﻿/*
+* IDIVTEST - DIV and MOD of Kronos3vm against the former bit-serial loop (c) KRONOS
+*
+* Purpose: _idiv in vm/int/SourceCode/VM.cpp was a shift and subtract loop on
+*          64-bit integers; it is a host division with a sign correction now.
+*          The loop is kept here and compared with kr_idiv from Idiv.h, which
+*          VM.cpp includes, for all pairs in -2000..2000, the sign and limit
+*          cases and 20M random pairs of mixed magnitudes; then both are
+*          timed on the same 10M random pairs.
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "Idiv.h"
+
+typedef long long qlong;
+
+static qlong qabs(qlong x) { return x >= 0 ? x : -x; }
+
+/* VM.cpp before the host division */
+static int idiv_old(qlong x, qlong y, int* rem)
+{
+	qlong z  = 0;
+	qlong bt = 1;
+	while (qabs(x) > qabs(y)) {
+		bt = bt << 1;
+		y  = y << 1;
+	}
+	for (;;) {
+		if ((x >= 0) == (y >= 0)) {
+			if (y < 0) {
+				if (x <= y) { x = x - y;    z = z + bt; }
+			} else {
+				if (x >= y) { x = x - y;    z = z + bt; }
+			}
+		} else {
+			if (y < 0) {
+				if (x > 0) { x = x + y;     z = z - bt; }
+			} else {
+				if (x < 0) { x = x + y;     z = z - bt; }
+			}
+		}
+		if (bt == 1)
+			break;
+		bt = bt >> 1;
+		if (y > 0)
+			y = (y & ~0x1) >> 1;
+		else
+			y = (y | 0x1) >> 1;
+	}
+	*rem = (int)x;
+	return (int)z;
+}
+
+static long bad;
+
+static void check(int x, int y)
+{
+	int r1 = 0, r2 = 0;
+	int q1 = idiv_old(x, y, &r1);
+	int q2 = kr_idiv(x, y, &r2);
+	if (q1 != q2 || r1 != r2) {
+		if (bad < 10)
+			printf("%d DIV %d: loop %d rem %d, host %d rem %d\n", x, y, q1, r1, q2, r2);
+		bad++;
+	}
+}
+
+static uint32_t seed = 12345;
+
+static uint32_t rnd(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+/* the same pairs for both, generated up front so rnd() is not timed */
+enum { TIMED = 10000000 };
+static int tx[TIMED], ty[TIMED];
+
+static void bench(void)
+{
+	int r = 0;
+	unsigned sum = 0;
+	for (int i = 0; i < TIMED; i++) {
+		tx[i] = (int)rnd() >> (rnd() % 32);
+		ty[i] = (int)rnd() >> (rnd() % 32);
+		if (ty[i] == 0)
+			ty[i] = 1;
+	}
+	clock_t t0 = clock();
+	for (int i = 0; i < TIMED; i++)
+		sum += idiv_old(tx[i], ty[i], &r) + r;
+	clock_t t1 = clock();
+	for (int i = 0; i < TIMED; i++)
+		sum += kr_idiv(tx[i], ty[i], &r) + r;
+	clock_t t2 = clock();
+	double o = (double)(t1 - t0) / CLOCKS_PER_SEC * 1e9 / TIMED;
+	double n = (double)(t2 - t1) / CLOCKS_PER_SEC * 1e9 / TIMED;
+	printf("loop %.1f ns, host %.1f ns per DIV (x%.1f) [%08x]\n",
+		o, n, n > 0 ? o / n : 0.0, sum);
+}
+
+int main(void)
+{
+	static const int edge[] = { 0, 1, -1, 2, -2, 0x7FFFFFFF, -0x7FFFFFFF, INT32_MIN,
+		0x40000000, -0x40000000, 0x3FFFFFFF, 65536, -65536 };
+	const int edges = sizeof(edge) / sizeof(edge[0]);
+	long pairs = 0;
+	for (int x = -2000; x <= 2000; x++)
+		for (int y = -2000; y <= 2000; y++)
+			if (y != 0) { check(x, y); pairs++; }
+	for (int a = 0; a < edges; a++)
+		for (int b = 0; b < edges; b++)
+			if (edge[b] != 0) { check(edge[a], edge[b]); pairs++; }
+	for (long i = 0; i < 20000000; i++) {
+		int x = (int)rnd();
+		int y = (int)rnd() >> (rnd() % 32);
+		if (y == 0)
+			continue;
+		check(x, y);
+		check(x >> (rnd() % 32), y);
+		pairs += 2;
+	}
+	printf("%ld pairs, %ld differ\n", pairs, bad);
+	if (bad == 0)
+		bench();
+	return bad == 0 ? 0 : 1;
+}
@@ -114,6 +114,10 @@ LINK32=link.exe
 # PROP Default_Filter "*.cpp"
 # Begin Source File
 
+SOURCE=.\SourceCode\Breaks.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\SourceCode\cO_tcp.cpp
 # End Source File
 # Begin Source File
@@ -130,22 +134,46 @@ SOURCE=.\SourceCode\crtStartup.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\SourceCode\Disasm.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\SourceCode\Disks.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\SourceCode\Gdb.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SourceCode\HostFs.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\SourceCode\IGD480.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\SourceCode\Journal.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\SourceCode\Kronos3vm.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\SourceCode\Lockstep.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\SourceCode\Memory.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\SourceCode\Metrics.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\SourceCode\preCompiled.cpp
 # ADD CPP /Yc"preCompiled.h"
 # End Source File
@@ -159,6 +187,14 @@ SOURCE=.\SourceCode\SIO_TCP.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\SourceCode\Telnet.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SourceCode\Tracer.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\SourceCode\VM.cpp
 # End Source File
 # Begin Source File
@@ -171,6 +207,10 @@ SOURCE=.\SourceCode\vmConsole.cpp
 # PROP Default_Filter "*.h"
 # Begin Source File
 
+SOURCE=.\SourceCode\Breaks.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\SourceCode\cO_tcp.h
 # End Source File
 # Begin Source File
@@ -183,18 +223,46 @@ SOURCE=.\SourceCode\cO_win32_display.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\SourceCode\Disasm.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\SourceCode\Disks.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\SourceCode\Gdb.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SourceCode\HostFs.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\SourceCode\IGD480.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\SourceCode\Idiv.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SourceCode\Journal.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SourceCode\Lockstep.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\SourceCode\Memory.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\SourceCode\Metrics.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\SourceCode\preCompiled.h
 # End Source File
 # Begin Source File
@@ -203,6 +271,10 @@ SOURCE=.\SourceCode\resource.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\SourceCode\Ring.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\SourceCode\SIO.h
 # End Source File
 # Begin Source File
@@ -211,6 +283,14 @@ SOURCE=.\SourceCode\SIO_TCP.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\SourceCode\Telnet.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SourceCode\Tracer.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\SourceCode\VM.h
 # End Source File
 # Begin Source File
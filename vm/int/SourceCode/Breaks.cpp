@@ -0,0 +1,389 @@
+//////////////////////////////////////////////////////////////////////////////
+// Breaks.cpp  breakpoints and watchpoints
+
+#include "preCompiled.h"
+#include "Memory.h"
+#include "Breaks.h"
+
+BREAKS* BREAKS::pThis = null;
+
+// XP and up, not in the VC6 headers:
+typedef LONG (__stdcall *VehHandler)(EXCEPTION_POINTERS*);
+typedef void* (__stdcall *AddVeh)(ULONG first, VehHandler handler);
+typedef ULONG (__stdcall *RemoveVeh)(void* handle);
+
+
+BREAKS::BREAKS() :
+    mem(null), attention(null), nBreak(0), lifted(-1), nWatch(0),
+    suspended(false), hitType(0), hitAdr(0), nOpen(0), hVeh(null)
+{
+}
+
+
+BREAKS::~BREAKS()
+{
+    if (hVeh != null)
+    {
+        RemoveVeh remove = (RemoveVeh)GetProcAddress(GetModuleHandle("kernel32.dll"),
+                                                     "RemoveVectoredExceptionHandler");
+        if (remove != null)
+            remove(hVeh);
+    }
+    pThis = null;
+}
+
+
+void BREAKS::Attach(MEMORY* m, bool* pAttention)
+{
+    mem = m;
+    attention = pAttention;
+}
+
+
+byte* BREAKS::At(int adr)
+{
+    if (mem == null || adr < 0 || adr >= mem->GetSize() * 4)
+        return null;
+    return &(*mem)[adr >> 2] + (adr & 3);
+}
+
+
+// Breakpoints.  Set() and Clear() come from the debugger with memory
+// suspended, Lift() and Replant() may run with watched pages closed.
+
+bool BREAKS::Set(int adr)
+{
+    if (Original(adr) >= 0)
+        return true;
+    byte* p = At(adr);
+    if (p == null || nBreak == maxBreak)
+        return false;
+    rgBreak[nBreak].adr  = adr;
+    rgBreak[nBreak].orig = *p;
+    rgBreak[nBreak].hidden = false;
+    nBreak++;
+    *p = BPT;
+    return true;
+}
+
+
+bool BREAKS::Clear(int adr)
+{
+    for (int i = 0; i < nBreak; i++)
+    {
+        if (rgBreak[i].adr == adr)
+        {
+            byte* p = At(adr);
+            if (*p == BPT)      // not overwritten by the guest meanwhile
+                *p = rgBreak[i].orig;
+            if (lifted == i)
+                lifted = -1;
+            rgBreak[i] = rgBreak[--nBreak];
+            if (lifted == nBreak)
+                lifted = i;
+            return true;
+        }
+    }
+    return true;
+}
+
+
+int BREAKS::Original(int adr)
+{
+    for (int i = 0; i < nBreak; i++)
+    {
+        if (rgBreak[i].adr == adr)
+            return rgBreak[i].orig;
+    }
+    return -1;
+}
+
+
+void BREAKS::Lift(int adr)
+{
+    Replant();
+    for (int i = 0; i < nBreak; i++)
+    {
+        if (rgBreak[i].adr == adr)
+        {
+            bool was = suspended;
+            Suspend();
+            *At(adr) = rgBreak[i].orig;
+            if (!was)
+                Resume(false);
+            lifted = i;
+            return;
+        }
+    }
+}
+
+
+void BREAKS::Replant()
+{
+    if (lifted < 0)
+        return;
+    bool was = suspended;
+    Suspend();
+    byte* p = At(rgBreak[lifted].adr);
+    if (*p == rgBreak[lifted].orig)
+        *p = BPT;
+    if (!was)
+        Resume(false);
+    lifted = -1;
+}
+
+
+void BREAKS::ClearAll()
+{
+    Resume(false);
+    while (nBreak > 0)
+        Clear(rgBreak[nBreak - 1].adr);
+    nWatch = 0;
+    hitType = 0;
+    Protect();
+}
+
+
+bool BREAKS::Peek(int adr, byte& b)
+{
+    byte* p = At(adr);
+    if (p == null)
+        return false;
+    int orig = Original(adr);
+    b = orig >= 0 && *p == BPT ? (byte)orig : *p;
+    return true;
+}
+
+
+bool BREAKS::Poke(int adr, byte b)
+{
+    byte* p = At(adr);
+    if (p == null)
+        return false;
+    for (int i = 0; i < nBreak; i++)
+    {
+        if (rgBreak[i].adr == adr && *p == BPT)
+        {
+            rgBreak[i].orig = b;
+            return true;
+        }
+    }
+    *p = b;
+    return true;
+}
+
+
+void BREAKS::Hide(int adr, int len)
+{
+    for (int i = 0; i < nBreak; i++)
+    {
+        Break& k = rgBreak[i];
+        byte* p = At(k.adr);
+        if (k.adr >= adr && k.adr - adr < len && *p == BPT)
+        {
+            *p = k.orig;
+            k.hidden = true;
+        }
+    }
+}
+
+
+void BREAKS::Unhide(int adr, int len)
+{
+    for (int i = 0; i < nBreak; i++)
+    {
+        Break& k = rgBreak[i];
+        if (k.hidden && k.adr >= adr && k.adr - adr < len)
+        {
+            byte* p = At(k.adr);
+            if (*p == k.orig)
+                *p = BPT;
+            k.hidden = false;
+        }
+    }
+}
+
+
+// Watchpoints.
+
+bool BREAKS::Watch(int type, int adr, int len)
+{
+    if (type < wWrite || type > wAccess || nWatch == maxWatch || mem == null)
+        return false;
+    int first = adr >> 2;
+    int last  = (adr + (len > 0 ? len : 1) - 1) >> 2;
+    if (adr < 0 || last - first >= 4 || last >= mem->GetSize())
+        return false;
+    if (hVeh == null)
+    {
+        AddVeh add = (AddVeh)GetProcAddress(GetModuleHandle("kernel32.dll"),
+                                            "AddVectoredExceptionHandler");
+        if (add == null)
+            return false;
+        pThis = this;
+        hVeh = add(1, Handler);
+        if (hVeh == null)
+            return false;
+    }
+    Watched& w = rgWatch[nWatch++];
+    w.type  = type;
+    w.adr   = adr;
+    w.len   = len;
+    w.first = first;
+    w.last  = last;
+    for (int i = 0; i <= last - first; i++)
+        w.old[i] = (*mem)[first + i];
+    if (!suspended)
+        Protect();
+    return true;
+}
+
+
+bool BREAKS::Unwatch(int type, int adr, int len)
+{
+    for (int i = 0; i < nWatch; i++)
+    {
+        if (rgWatch[i].type == type && rgWatch[i].adr == adr && rgWatch[i].len == len)
+        {
+            rgWatch[i] = rgWatch[--nWatch];
+            if (!suspended)
+                Protect();
+            return true;
+        }
+    }
+    return true;
+}
+
+
+bool BREAKS::Triggered(int& type, int& adr)
+{
+    if (hitType == 0)
+        return false;
+    type = hitType;
+    adr  = hitAdr;
+    hitType = 0;
+    return true;
+}
+
+
+void BREAKS::Hit(int word, bool bWrite)
+{
+    for (int i = 0; i < nWatch; i++)
+    {
+        Watched& w = rgWatch[i];
+        if (word >= w.first && word <= w.last &&
+            (w.type == wAccess || (w.type == wWrite) == bWrite))
+        {
+            hitType = w.type;
+            hitAdr  = w.adr;
+            *attention = true;
+            return;
+        }
+    }
+}
+
+
+// whole memory read/write, then close the watched pages
+void BREAKS::Protect()
+{
+    if (mem == null)
+        return;
+    byte* base = &(*mem)[0];
+    dword old = 0;
+    VirtualProtect(base, mem->GetSize() * 4, PAGE_READWRITE, &old);
+    for (int i = 0; i < nWatch; i++)
+    {
+        Watched& w = rgWatch[i];
+        dword prot = w.type == wWrite ? PAGE_READONLY : PAGE_NOACCESS;
+        for (int pg = w.first * 4 / Page; pg <= w.last * 4 / Page; pg++)
+        {
+            MEMORY_BASIC_INFORMATION mbi;
+            VirtualQuery(base + pg * Page, &mbi, sizeof mbi);
+            if (mbi.Protect != PAGE_NOACCESS)   // read watch wins
+                VirtualProtect(base + pg * Page, Page, prot, &old);
+        }
+    }
+}
+
+
+void BREAKS::Open()
+{
+    byte* base = &(*mem)[0];
+    dword old = 0;
+    VirtualProtect(base, mem->GetSize() * 4, PAGE_READWRITE, &old);
+    for (int i = 0; i < nWatch; i++)
+    {
+        Watched& w = rgWatch[i];
+        for (int j = 0; j <= w.last - w.first; j++)
+            w.old[j] = (*mem)[w.first + j];
+    }
+    suspended = true;
+}
+
+
+void BREAKS::Close(bool bCheck)
+{
+    for (int i = 0; i < nWatch && bCheck; i++)
+    {
+        Watched& w = rgWatch[i];
+        for (int j = 0; j <= w.last - w.first; j++)
+        {
+            if (w.type != wRead && w.old[j] != (dword)(int)(*mem)[w.first + j])
+                Hit(w.first + j, true);
+        }
+    }
+    suspended = false;
+    Protect();
+}
+
+
+// protection of a watched page as Protect() leaves it
+void BREAKS::Shut(byte* page)
+{
+    byte* base = &(*mem)[0];
+    int first = (page - base) / 4;
+    int last  = first + Page / 4 - 1;
+    dword prot = PAGE_READWRITE;
+    for (int i = 0; i < nWatch; i++)
+    {
+        Watched& w = rgWatch[i];
+        if (w.first <= last && w.last >= first && prot != PAGE_NOACCESS)
+            prot = w.type == wWrite ? PAGE_READONLY : PAGE_NOACCESS;
+    }
+    dword old = 0;
+    VirtualProtect(page, Page, prot, &old);
+}
+
+
+LONG __stdcall BREAKS::Handler(EXCEPTION_POINTERS* p)
+{
+    BREAKS* b = pThis;
+    EXCEPTION_RECORD* r = p->ExceptionRecord;
+    if (b == null || b->mem == null)
+        return EXCEPTION_CONTINUE_SEARCH;
+    byte* base = &(*b->mem)[0];
+
+    if (r->ExceptionCode == EXCEPTION_SINGLE_STEP && b->nOpen > 0)
+    {
+        // the access is done, close the pages again:
+        while (b->nOpen > 0)
+            b->Shut(b->rgOpen[--b->nOpen]);
+        return EXCEPTION_CONTINUE_EXECUTION;
+    }
+
+    if (r->ExceptionCode == EXCEPTION_ACCESS_VIOLATION && r->NumberParameters >= 2 &&
+        b->nWatch > 0 && b->nOpen < maxOpen)
+    {
+        byte* a = (byte*)r->ExceptionInformation[1];
+        if (a < base || a >= base + b->mem->GetSize() * 4)
+            return EXCEPTION_CONTINUE_SEARCH;
+        b->Hit((a - base) / 4, r->ExceptionInformation[0] == 1);
+        byte* page = base + (((a - base) / Page) * Page);
+        b->rgOpen[b->nOpen++] = page;
+        dword old = 0;
+        VirtualProtect(page, Page, PAGE_READWRITE, &old);
+        p->ContextRecord->EFlags |= 0x100;  // trap flag: step over the access
+        return EXCEPTION_CONTINUE_EXECUTION;
+    }
+    return EXCEPTION_CONTINUE_SEARCH;
+}
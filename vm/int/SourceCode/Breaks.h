@@ -0,0 +1,110 @@
+//////////////////////////////////////////////////////////////////////////////
+// Breaks.h  breakpoints and watchpoints that cost nothing while not hit
+//
+// A breakpoint replaces the code byte with NII (0xFD), whose handler asks
+// the debugger whether the address is one of ours; the original byte is
+// kept here and shown to the debugger instead.  Running over a breakpoint
+// lifts it for one instruction.  io2 disk writes get the original bytes
+// too (Hide()/Unhide()); the guest itself still reads NII where it reads
+// its code as data (constants, checksums), as on a machine with a monitor
+// planting breakpoints.
+//
+// Watchpoints protect the pages of MEMORY that hold the watched words
+// (read only for write watches, no access otherwise).  A fault on such a
+// page is resolved by the vectored exception handler: the page is opened,
+// the faulting host instruction is single stepped and the page closed
+// again.  An instruction may fault on several pages (rep movs from a read
+// watched page to a write watched one), each is opened in turn and all
+// are closed by the single step.  If the access hits a watched word bDebug is set and the VM stops
+// after the instruction.  Unwatched words on a watched page only pay for
+// the fault.
+//
+// Host side access (disk and host file i/o, the debugger itself) is
+// bracketed by Suspend()/Resume(): pages are opened and watched words are
+// compared instead (checked access).
+
+#pragma once
+
+class MEMORY;
+
+class BREAKS
+{
+public:
+    enum { BPT = 0xFD };                                // NII
+    enum { wWrite = 2, wRead = 3, wAccess = 4 };        // as gdb Z2..Z4
+
+    BREAKS();
+    virtual ~BREAKS();
+
+    void Attach(MEMORY* m, bool* pAttention);           // VM constructor
+
+    bool Set(int adr);          // byte address of an instruction
+    bool Clear(int adr);
+    int  Original(int adr);     // saved code byte, -1 if no breakpoint
+    void Lift(int adr);         // original byte back for one instruction
+    void Replant();
+    inline bool Lifted() const { return lifted >= 0; }
+    void ClearAll();
+
+    bool Watch(int type, int adr, int len);
+    bool Unwatch(int type, int adr, int len);
+    bool Triggered(int& type, int& adr);    // and forget
+
+    bool Peek(int adr, byte& b);            // the debugger's view
+    bool Poke(int adr, byte b);
+    void Hide(int adr, int len);            // original bytes in [adr, adr+len)
+    void Unhide(int adr, int len);          // NII back after the disk write
+
+    inline void Suspend() { if (nWatch > 0 && !suspended) Open(); }
+    inline void Resume(bool bCheck = true) { if (suspended) Close(bCheck); }
+
+private:
+    enum
+    {
+        maxBreak = 64,
+        maxWatch = 8,
+        maxOpen  = maxWatch * 2,    // pages opened for one host instruction
+        Page     = 4 * K    // bytes
+    };
+
+    struct Break
+    {
+        int  adr;
+        byte orig;
+        bool hidden;
+    };
+
+    struct Watched
+    {
+        int   type;
+        int   adr;          // bytes, as given by the debugger
+        int   len;
+        int   first;        // words
+        int   last;
+        dword old[4];       // checked access
+    };
+
+    MEMORY* mem;
+    bool*   attention;
+    int     nBreak;
+    Break   rgBreak[maxBreak];
+    int     lifted;         // index in rgBreak or -1
+    int     nWatch;
+    Watched rgWatch[maxWatch];
+    bool    suspended;
+    int     hitType;
+    int     hitAdr;
+    int     nOpen;
+    byte*   rgOpen[maxOpen];    // pages opened by the exception handler
+    void*   hVeh;
+
+    byte* At(int adr);
+    void  Protect();
+    void  Open();
+    void  Close(bool bCheck);
+    void  Hit(int word, bool bWrite);
+    void  Shut(byte* page);
+
+    static BREAKS* pThis;
+    static LONG __stdcall Handler(EXCEPTION_POINTERS* p);
+};
@@ -0,0 +1,87 @@
+//////////////////////////////////////////////////////////////////////////////
+// Disasm.cpp  one instruction as text, names as in excelsior defCodes.d
+
+#include "preCompiled.h"
+#include "Disasm.h"
+
+
+static const char* szName[256] =
+{
+    "LI0", "LI1", "LI2", "LI3", "LI4", "LI5", "LI6", "LI7",
+    "LI8", "LI9", "LI0A", "LI0B", "LI0C", "LI0D", "LI0E", "LI0F",
+    "LIB", "LID", "LIW", "LIN", "LLA", "LGA", "LSA", "LEA",
+    "JFLC", "JFL", "JFSC", "JFS", "JBLC", "JBL", "JBSC", "JBS",
+    "LLW", "LGW", "LEW", "LSW", "LLW4", "LLW5", "LLW6", "LLW7",
+    "LLW8", "LLW9", "LLW0A", "LLW0B", "LLW0C", "LLW0D", "LLW0E", "LLW0F",
+    "SLW", "SGW", "SEW", "SSW", "SLW4", "SLW5", "SLW6", "SLW7",
+    "SLW8", "SLW9", "SLW0A", "SLW0B", "SLW0C", "SLW0D", "SLW0E", "SLW0F",
+    "LXB", "LXW", "LGW2", "LGW3", "LGW4", "LGW5", "LGW6", "LGW7",
+    "LGW8", "LGW9", "LGW0A", "LGW0B", "LGW0C", "LGW0D", "LGW0E", "LGW0F",
+    "SXB", "SXW", "SGW2", "SGW3", "SGW4", "SGW5", "SGW6", "SGW7",
+    "SGW8", "SGW9", "SGW0A", "SGW0B", "SGW0C", "SGW0D", "SGW0E", "SGW0F",
+    "LSW0", "LSW1", "LSW2", "LSW3", "LSW4", "LSW5", "LSW6", "LSW7",
+    "LSW8", "LSW9", "LSW0A", "LSW0B", "LSW0C", "LSW0D", "LSW0E", "LSW0F",
+    "SSW0", "SSW1", "SSW2", "SSW3", "SSW4", "SSW5", "SSW6", "SSW7",
+    "SSW8", "SSW9", "SSW0A", "SSW0B", "SSW0C", "SSW0D", "SSW0E", "SSW0F",
+    "RESET", "QUIT", "GETM", "SETM", "TRAP", "TRA", "TR", "IDLE",
+    "ADD", "SUB", "MUL", "DIV", "SHL", "SHR", "ROL", "ROR",
+    "IO0", "IO1", "IO2", "IO3", "IO4", "RCMP", "WMV", "BMV",
+    "FADD", "FSUB", "FMUL", "FDIV", "FCMP", "FABS", "FNEG", "FFCT",
+    "LSS", "LEQ", "GTR", "GEQ", "EQU", "NEQ", "ABS", "NEG",
+    "OR", "AND", "XOR", "BIC", "IN", "BIT", "NOT", "MOD",
+    "DECS", "DROP", "LODFV", "STORE", "STOFV", "COPT", "CPCOP", "PCOP",
+    "FOR1", "FOR2", "ENTC", "XIT", "ADDPC", "JUMP", "ORJP", "ANDJP",
+    "MOVE", "CHKNIL", "LSTA", "COMP", "GB", "GB1", "CHK", "CHKZ",
+    "ALLOC", "ENTR", "RTN", "NOP", "CX", "CI", "CF", "CL",
+    "CL0", "CL1", "CL2", "CL3", "CL4", "CL5", "CL6", "CL7",
+    "CL8", "CL9", "CL0A", "CL0B", "CL0C", "CL0D", "CL0E", "CL0F",
+    "INCL", "EXCL", "INL", "QUOT", "INC1", "DEC1", "INC", "DEC",
+    "STOT", "LODT", "LXA", "LPC", "BBU", "BBP", "BBLT", "PDX",
+    "SWAP", "LPA", "LPW", "SPW", "SSWU", "RCHK", "RCHKZ", "CM",
+    "CHKBOX", "BMG", "ACTIV", "USR", "SYS", "NII", "DOT", "INVLD",
+};
+
+// operand bytes after the opcode, as taken by VM::Run()
+static const byte nOperand[256] =
+{
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 00
+    1, 2, 4, 0, 1, 1, 1, 2, 2, 2, 1, 1, 2, 2, 1, 1,  // 10
+    1, 1, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 20
+    1, 1, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 30
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 40
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 50
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 60
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 70
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 80
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 90
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // A0
+    0, 0, 0, 0, 0, 0, 1, 1, 3, 3, 2, 0, 0, 0, 1, 1,  // B0
+    0, 0, 2, 0, 1, 0, 0, 0, 0, 1, 0, 0, 2, 1, 0, 1,  // C0
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // D0
+    0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 2, 0, 0, 0, 0,  // E0
+    0, 1, 1, 1, 0, 0, 0, 1, 0, 1, 0, 1, 1, 0, 0, 0,  // F0
+};
+
+
+int Disasm(const byte* code, int pc, char* buf)
+{
+    int op = code[pc];
+    int n = nOperand[op];
+    int len = wsprintf(buf, "%08X %02X", pc, op);
+    for (int i = 1; i <= n; i++)
+        len += wsprintf(buf + len, "%02X", code[pc + i]);
+    while (len < 22)
+        buf[len++] = ' ';
+    len += wsprintf(buf + len, "%s", szName[op]);
+    if (n == 1)
+        wsprintf(buf + len, " %d", code[pc + 1]);
+    else if (op == 0xCC || op == 0xEB)  // CX, LPC: module, procedure
+        wsprintf(buf + len, " %d,%d", code[pc + 1], code[pc + 2]);
+    else if (n == 2)
+        wsprintf(buf + len, " %d", *(word*)&code[pc + 1]);
+    else if (n == 4)
+        wsprintf(buf + len, " %08X", *(dword*)&code[pc + 1]);
+    else if (n == 3)
+        wsprintf(buf + len, " %d,%d", code[pc + 1], *(word*)&code[pc + 2]);
+    return n + 1;
+}
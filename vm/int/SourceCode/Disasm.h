@@ -0,0 +1,7 @@
+//////////////////////////////////////////////////////////////////////////////
+// Disasm.h  Kronos instruction disassembler for the VM's own reports
+
+#pragma once
+
+// code[pc] as "address  bytes  mnemonic operand", returns instruction length
+int Disasm(const byte* code, int pc, char* buf);   // buf: 64 chars
@@ -0,0 +1,446 @@
+//////////////////////////////////////////////////////////////////////////////
+// Gdb.cpp  GDB remote serial protocol stub
+
+#include "preCompiled.h"
+#include <winsock2.h>
+#include "Disks.h"
+#include "HostFs.h"
+#include "Memory.h"
+#include "IGD480.h"
+#include "Tracer.h"
+#include "Journal.h"
+#include "Breaks.h"
+#include "Gdb.h"
+#include "Metrics.h"
+#include "Lockstep.h"
+#include "VM.h"
+
+static const char hex[] = "0123456789abcdef";
+
+static int unhex(char ch)
+{
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return -1;
+}
+
+// hex number, stops at the first non hex character
+static dword number(char*& p)
+{
+    dword v = 0;
+    while (unhex(*p) >= 0)
+        v = (v << 4) | unhex(*p++);
+    return v;
+}
+
+// 32 bit little endian, as the debugger expects registers
+static char* putword(char* s, dword v)
+{
+    for (int i = 0; i < 4; i++, v >>= 8)
+    {
+        *s++ = hex[(v >> 4) & 0xF];
+        *s++ = hex[v & 0xF];
+    }
+    *s = 0;
+    return s;
+}
+
+static dword getword(char*& p)
+{
+    dword v = 0;
+    for (int i = 0; i < 4 && unhex(p[0]) >= 0 && unhex(p[1]) >= 0; i++, p += 2)
+        v |= (dword)(unhex(p[0]) << 4 | unhex(p[1])) << (8 * i);
+    return v;
+}
+
+
+GDBSTUB::GDBSTUB() :
+    listener((dword)-1), client((dword)-1), fresh(false), request(false), running(true),
+    stepping(false), armed(false), icount(0)
+{
+}
+
+
+GDBSTUB::~GDBSTUB()
+{
+    if (client != (dword)-1)
+        closesocket(client);
+    if (listener != (dword)-1)
+        closesocket(listener);
+}
+
+
+// winsock is started by SioTcps::start()
+bool GDBSTUB::Open(int port)
+{
+    SOCKET so = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (so == INVALID_SOCKET)
+        return false;
+
+    SOCKADDR_IN sin;
+    sin.sin_family = AF_INET;
+    sin.sin_port   = htons((word)port);
+    sin.sin_addr.S_un.S_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(so, (SOCKADDR *)&sin, sizeof(sin)) != 0 || listen(so, 1) != 0)
+    {
+        closesocket(so);
+        return false;
+    }
+    dword nonBlocking = 1;
+    ioctlsocket(so, FIONBIO, &nonBlocking);
+    listener = so;
+    return true;
+}
+
+
+bool GDBSTUB::Poll()
+{
+    if (listener == (dword)-1 || !running)
+        return false;
+    if (client == (dword)-1)
+    {
+        SOCKADDR_IN sin;
+        int len = sizeof(sin);
+        SOCKET so = accept(listener, (SOCKADDR *)&sin, &len);
+        if (so == INVALID_SOCKET)
+            return false;
+        dword blocking = 0;
+        ioctlsocket(so, FIONBIO, &blocking);
+        client = so;
+        fresh = true;
+        request = true;
+    }
+    else
+    {
+        fd_set rd;
+        FD_ZERO(&rd);
+        FD_SET(client, &rd);
+        timeval tv = { 0, 0 };
+        if (select(0, &rd, null, null, &tv) > 0)
+            request = true;     // ^C or the debugger went away
+    }
+    return request;
+}
+
+
+bool GDBSTUB::Check(VM& vm)
+{
+    if (!Attached())
+        return false;
+    bool moved = vm.icount != icount;   // an instruction ran since resume
+    if (moved)
+        vm.Breaks.Replant();
+    char stop[64];
+    stop[0] = 0;
+    int type = 0;
+    int adr = 0;
+    if (request)
+        strcpy(stop, "T02");
+    else if (vm.Breaks.Triggered(type, adr))
+        wsprintf(stop, "T05%s:%x;", type == BREAKS::wWrite ? "watch" :
+                                    type == BREAKS::wRead  ? "rwatch" : "awatch", adr);
+    else if (stepping && moved)
+        strcpy(stop, "T05");
+    else if (!armed)
+        strcpy(stop, "T05");    // bDebug set by the VM itself (e.g. unexpected trap)
+    if (stop[0] != 0)
+        Stop(vm, stop);
+    else
+        armed = stepping || vm.Breaks.Lifted();
+    return armed;
+}
+
+
+bool GDBSTUB::Breakpoint(VM& vm)
+{
+    int pc = vm.F * 4 + vm.PCs;
+    if (!Attached() || vm.Breaks.Original(pc) < 0)
+        return false;
+    vm.PC = vm.PCs;
+    vm.icount--;    // the NII was counted, the original instruction will be
+    Stop(vm, "T05swbreak:;");
+    vm.bDebug = armed;
+    return true;
+}
+
+
+void GDBSTUB::Stop(VM& vm, const char* stop)
+{
+    running = false;
+    request = false;
+    stepping = false;
+    vm.Breaks.Suspend();
+    // a new debugger asks for the stop reason itself
+    if (!Session(vm, fresh ? null : stop))
+        Detach(vm);
+    fresh = false;
+    vm.Breaks.Resume(false);
+    icount = vm.icount;
+    int pc = vm.F * 4 + vm.PC;
+    if (vm.Breaks.Original(pc) >= 0)
+        vm.Breaks.Lift(pc);     // the original instruction runs first
+    armed = stepping || vm.Breaks.Lifted();
+    running = true;
+}
+
+
+// talk to the debugger until it resumes the machine
+bool GDBSTUB::Session(VM& vm, const char* stop)
+{
+    if (stop != null && !Send(stop))
+        return false;
+    for (;;)
+    {
+        int n = Receive();
+        if (n < 0)
+            return false;
+        bool resume = false;
+        if (!Command(vm, pkt, n, resume))
+            return false;
+        if (resume)
+            return true;
+    }
+}
+
+
+// $data#cs -> pkt, acknowledged; ^C and acks between packets are skipped
+int GDBSTUB::Receive()
+{
+    char ch = 0;
+    for (;;)
+    {
+        do
+        {
+            if (recv(client, &ch, 1, 0) != 1)
+                return -1;
+        }
+        while (ch != '$');
+
+        int n = 0;
+        byte sum = 0;
+        for (;;)
+        {
+            if (recv(client, &ch, 1, 0) != 1)
+                return -1;
+            if (ch == '#')
+                break;
+            sum = (byte)(sum + ch);
+            if (n < maxPacket - 1)
+                pkt[n++] = ch;
+        }
+        pkt[n] = 0;
+        char cs[2];
+        if (recv(client, &cs[0], 1, 0) != 1 || recv(client, &cs[1], 1, 0) != 1)
+            return -1;
+        bool ok = unhex(cs[0]) >= 0 && unhex(cs[1]) >= 0 &&
+                  (unhex(cs[0]) << 4 | unhex(cs[1])) == sum;
+        if (send(client, ok ? "+" : "-", 1, 0) != 1)
+            return -1;
+        if (ok)
+            return n;
+    }
+}
+
+
+bool GDBSTUB::Send(const char* s)
+{
+    static char buf[maxPacket + 4];
+    byte sum = 0;
+    int n = 0;
+    buf[n++] = '$';
+    for (; *s != 0 && n < maxPacket; s++)
+    {
+        buf[n++] = *s;
+        sum = (byte)(sum + *s);
+    }
+    buf[n++] = '#';
+    buf[n++] = hex[sum >> 4];
+    buf[n++] = hex[sum & 0xF];
+    for (int tries = 0; tries < 3; tries++)
+    {
+        if (send(client, buf, n, 0) != n)
+            return false;
+        char ch = 0;
+        do
+        {
+            if (recv(client, &ch, 1, 0) != 1)
+                return false;
+        }
+        while (ch != '+' && ch != '-');
+        if (ch == '+')
+            return true;
+    }
+    return false;
+}
+
+
+void GDBSTUB::Detach(VM& vm)
+{
+    if (client != (dword)-1)
+        closesocket(client);
+    client = (dword)-1;
+    vm.Breaks.ClearAll();
+    stepping = false;
+    request = false;
+}
+
+
+bool GDBSTUB::Command(VM& vm, char* cmd, int n, bool& resume)
+{
+    char* p = cmd + 1;
+    out[0] = 0;
+    switch (cmd[0])
+    {
+        case '?':
+            strcpy(out, "S05");
+            break;
+        case 'q':
+            if (memcmp(cmd, "qSupported", 10) == 0)
+                wsprintf(out, "PacketSize=%x;swbreak+", maxPacket - 16);
+            else if (memcmp(cmd, "qAttached", 9) == 0)
+                strcpy(out, "1");
+            else if (memcmp(cmd, "qC", 2) == 0 && n == 2)
+                strcpy(out, "QC1");
+            break;
+        case 'H':
+            strcpy(out, "OK");
+            break;
+        case 'g':
+        {
+            char* s = out;
+            for (int i = 0; i < nRegs; i++)
+                s = putword(s, GetReg(vm, i));
+            break;
+        }
+        case 'G':
+            for (int i = 0; i < nRegs && *p != 0; i++)
+                SetReg(vm, i, getword(p));
+            strcpy(out, "OK");
+            break;
+        case 'p':
+        {
+            int i = number(p);
+            if (i < nRegs)
+                putword(out, GetReg(vm, i));
+            else
+                strcpy(out, "E01");
+            break;
+        }
+        case 'P':
+        {
+            int i = number(p);
+            if (*p++ != '=' || i >= nRegs)
+                strcpy(out, "E01");
+            else
+            {
+                SetReg(vm, i, getword(p));
+                strcpy(out, "OK");
+            }
+            break;
+        }
+        case 'm':
+        {
+            int adr = number(p); p++;
+            int len = number(p);
+            if (len > (maxPacket - 16) / 2)
+                len = (maxPacket - 16) / 2;
+            char* s = out;
+            for (int i = 0; i < len; i++)
+            {
+                byte b = 0;
+                if (!vm.Breaks.Peek(adr + i, b))
+                    break;
+                *s++ = hex[b >> 4];
+                *s++ = hex[b & 0xF];
+            }
+            *s = 0;
+            if (len > 0 && s == out)
+                strcpy(out, "E01");
+            break;
+        }
+        case 'M':
+        {
+            int adr = number(p); p++;
+            int len = number(p); p++;
+            strcpy(out, "OK");
+            for (int i = 0; i < len; i++, p += 2)
+            {
+                if (unhex(p[0]) < 0 || unhex(p[1]) < 0 ||
+                    !vm.Breaks.Poke(adr + i, (byte)(unhex(p[0]) << 4 | unhex(p[1]))))
+                {
+                    strcpy(out, "E01");
+                    break;
+                }
+            }
+            break;
+        }
+        case 'c':
+        case 's':
+            if (*p != 0)
+                SetReg(vm, 0, number(p));
+            stepping = cmd[0] == 's';
+            resume = true;
+            return true;    // the stop reply is sent when the machine stops
+        case 'Z':
+        case 'z':
+        {
+            int type = number(p); p++;
+            int adr  = number(p); p++;
+            int len  = number(p);
+            bool ok = false;
+            if (type <= 1)
+                ok = cmd[0] == 'Z' ? vm.Breaks.Set(adr) : vm.Breaks.Clear(adr);
+            else if (type <= 4)
+                ok = cmd[0] == 'Z' ? vm.Breaks.Watch(type, adr, len) :
+                                     vm.Breaks.Unwatch(type, adr, len);
+            strcpy(out, ok ? "OK" : "E01");
+            break;
+        }
+        case 'D':
+            Send("OK");
+            return false;
+        case 'k':
+            return false;
+        default:
+            break;          // empty reply: not supported
+    }
+    return Send(out);
+}
+
+
+dword GDBSTUB::GetReg(VM& vm, int n)
+{
+    switch (n)
+    {
+        case 0: return vm.F * 4 + vm.PC;
+        case 1: return vm.F;
+        case 2: return vm.G;
+        case 3: return vm.L;
+        case 4: return vm.S;
+        case 5: return vm.H;
+        case 6: return vm.P;
+        case 7: return vm.M;
+        case 8: return vm.sp;
+        default: return vm.AStack[n - 9];
+    }
+}
+
+
+void GDBSTUB::SetReg(VM& vm, int n, dword v)
+{
+    switch (n)
+    {
+        case 0: vm.PC = v - vm.F * 4; break;
+        case 1: vm.F = v; vm.code = vm.GetCode(vm.F); break;
+        case 2: vm.G = v; break;
+        case 3: vm.L = v; break;
+        case 4: vm.S = v; break;
+        case 5: vm.H = v; break;
+        case 6: vm.P = v; break;
+        case 7: vm.M = v; break;
+        case 8: vm.sp = v <= AStackSize ? v : AStackSize; break;
+        default: vm.AStack[n - 9] = v; break;
+    }
+}
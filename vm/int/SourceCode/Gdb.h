@@ -0,0 +1,60 @@
+//////////////////////////////////////////////////////////////////////////////
+// Gdb.h  GDB remote serial protocol stub (-gdb:port, 127.0.0.1 only)
+//
+// The timer thread accepts the connection and notices ^C, the VM thread
+// talks to the debugger while the machine is stopped.  Stops come through
+// the bDebug test the interpreter does anyway; breakpoints and watchpoints
+// are planted in memory (see Breaks.h), so the machine runs at full speed
+// with any number of them set.
+//
+// Addresses are byte addresses of the word memory (word n = byte 4n);
+// "pc" is the byte address of the next instruction, F*4 + PC.
+// Registers, 32 bits each:
+//      0 pc  1 F  2 G  3 L  4 S  5 H  6 P  7 M  8 sp (A-stack depth)
+//      9..23 A-stack[0..14]
+// Breakpoints: Z0/Z1.  Watchpoints: Z2 (write), Z3 (read), Z4 (access).
+
+#pragma once
+
+class VM;
+
+class GDBSTUB
+{
+public:
+    GDBSTUB();
+    virtual ~GDBSTUB();
+
+    bool Open(int port);
+    bool Poll();                // timer thread: true if the VM should stop
+    inline bool Attached() const { return client != (dword)-1; }
+    bool Check(VM& vm);         // VM thread: returns new value of bDebug
+    bool Breakpoint(VM& vm);    // NII executed: false if not planted by us
+
+private:
+    enum
+    {
+        nRegs     = 9 + 15,
+        maxPacket = 4 * K
+    };
+
+    dword listener;
+    dword client;
+    bool  fresh;                // connected, no stop reported yet
+    volatile bool request;      // connect or ^C seen by Poll()
+    volatile bool running;      // VM thread is not talking to the debugger
+    bool  stepping;
+    bool  armed;                // what Check() returned last time
+    qword icount;               // VM::icount when the machine was resumed
+    char  pkt[maxPacket];
+    char  out[maxPacket];
+
+    void Stop(VM& vm, const char* stop);
+    bool Session(VM& vm, const char* stop);  // false: debugger went away
+    bool Command(VM& vm, char* cmd, int n, bool& resume);
+    int  Receive();             // packet length, -1 connection closed
+    bool Send(const char* s);
+    void Detach(VM& vm);
+
+    dword GetReg(VM& vm, int n);
+    void  SetReg(VM& vm, int n, dword v);
+};
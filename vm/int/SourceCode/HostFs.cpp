@@ -0,0 +1,204 @@
+//////////////////////////////////////////////////////////////////////////////
+// HostFs.cpp  host directory access for the guest (io4)
+
+#include "preCompiled.h"
+#include "HostFs.h"
+
+HOSTFS::HOSTFS()
+{
+    for (int i = 0; i < N; i++)
+        hFile[i] = INVALID_HANDLE_VALUE;
+    memset(bDir, 0, sizeof bDir);
+    memset(bFirst, 0, sizeof bFirst);
+    szRoot[0] = 0;
+}
+
+
+HOSTFS::~HOSTFS()
+{
+    for (int i = 0; i < N; i++)
+        Close(i);
+}
+
+
+bool HOSTFS::SetRoot(const char* szDir)
+{
+    int n = strlen(szDir);
+    if (n == 0 || n > MAX_PATH - 16)
+        return false;
+    dword attr = GetFileAttributes(szDir);
+    if (attr == INVALID_FILE_ATTRIBUTES || (attr & FILE_ATTRIBUTE_DIRECTORY) == 0)
+        return false;
+    strcpy(szRoot, szDir);
+    if (szRoot[n-1] != '\\' && szRoot[n-1] != '/')
+        strcpy(szRoot + n, "\\");
+    return true;
+}
+
+
+bool HOSTFS::Enabled()
+{
+    return szRoot[0] != 0;
+}
+
+
+bool HOSTFS::MakePath(char* szPath, const byte* name, int len)
+{
+    int n = strlen(szRoot);
+    if (!Enabled() || len < 0 || n + len >= MAX_PATH)
+        return false;
+    strcpy(szPath, szRoot);
+    for (int i = 0; i < len; i++)
+    {
+        char ch = name[i];
+        if (ch == 0)
+            break;
+        if (ch == '/')
+            ch = '\\';
+        if ((byte)ch < ' ' || ch == ':' || (ch == '\\' && i == 0))
+            return false;
+        if (ch == '.' && i + 1 < len && name[i+1] == '.')
+            return false;
+        szPath[n++] = ch;
+    }
+    szPath[n] = 0;
+    return true;
+}
+
+
+int HOSTFS::Alloc()
+{
+    for (int i = 0; i < N; i++)
+    {
+        if (hFile[i] == INVALID_HANDLE_VALUE)
+            return i;
+    }
+    return -ERROR_TOO_MANY_OPEN_FILES;
+}
+
+
+bool HOSTFS::Valid(int h, bool dir)
+{
+    return h >= 0 && h < N && hFile[h] != INVALID_HANDLE_VALUE && bDir[h] == dir;
+}
+
+
+int HOSTFS::Error()
+{
+    int e = GetLastError();
+    return e == 0 ? -ERROR_GEN_FAILURE : -e;
+}
+
+
+int HOSTFS::Open(const byte* name, int len, int mode)
+{
+    char szPath[MAX_PATH];
+    if (!MakePath(szPath, name, len) || len == 0)
+        return -ERROR_INVALID_NAME;
+    int h = Alloc();
+    if (h < 0)
+        return h;
+    if (mode == 0)
+        hFile[h] = CreateFile(szPath, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    else
+        hFile[h] = CreateFile(szPath, GENERIC_WRITE, 0, NULL,
+                              CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hFile[h] == INVALID_HANDLE_VALUE)
+        return Error();
+    bDir[h] = false;
+    return h;
+}
+
+
+int HOSTFS::Close(int h)
+{
+    if (h < 0 || h >= N || hFile[h] == INVALID_HANDLE_VALUE)
+        return -ERROR_INVALID_HANDLE;
+    if (bDir[h])
+        FindClose(hFile[h]);
+    else
+        CloseHandle(hFile[h]);
+    hFile[h] = INVALID_HANDLE_VALUE;
+    return 0;
+}
+
+
+int HOSTFS::Read(int h, byte* adr, int len)
+{
+    if (!Valid(h, false))
+        return -ERROR_INVALID_HANDLE;
+    dword dw = 0;
+    if (!ReadFile(hFile[h], adr, len, &dw, NULL))
+        return Error();
+    return dw;
+}
+
+
+int HOSTFS::Write(int h, const byte* adr, int len)
+{
+    if (!Valid(h, false))
+        return -ERROR_INVALID_HANDLE;
+    dword dw = 0;
+    if (!WriteFile(hFile[h], adr, len, &dw, NULL))
+        return Error();
+    return dw;
+}
+
+
+int HOSTFS::Size(int h)
+{
+    if (!Valid(h, false))
+        return -ERROR_INVALID_HANDLE;
+    dword hi = 0;
+    dword lo = GetFileSize(hFile[h], &hi);
+    if (lo == INVALID_FILE_SIZE && GetLastError() != NO_ERROR)
+        return Error();
+    if (hi != 0 || lo > 0x7FFFFFFF)
+        return -ERROR_FILE_TOO_LARGE;
+    return lo;
+}
+
+
+int HOSTFS::OpenDir(const byte* pattern, int len)
+{
+    char szPath[MAX_PATH];
+    if (!MakePath(szPath, pattern, len))
+        return -ERROR_INVALID_NAME;
+    if (len == 0 || pattern[0] == 0)
+        strcpy(szPath + strlen(szPath), "*");
+    int h = Alloc();
+    if (h < 0)
+        return h;
+    hFile[h] = FindFirstFile(szPath, &fd[h]);
+    if (hFile[h] == INVALID_HANDLE_VALUE)
+        return GetLastError() == ERROR_FILE_NOT_FOUND ? -ERROR_NO_MORE_FILES : Error();
+    bDir[h] = true;
+    bFirst[h] = true;
+    return h;
+}
+
+
+int HOSTFS::ReadDir(int h, byte* adr, int len)
+{
+    if (!Valid(h, true))
+        return -ERROR_INVALID_HANDLE;
+    for (;;)
+    {
+        if (!bFirst[h] && !FindNextFile(hFile[h], &fd[h]))
+            return GetLastError() == ERROR_NO_MORE_FILES ? 0 : Error();
+        bFirst[h] = false;
+        const char* s = fd[h].cFileName;
+        if (strcmp(s, ".") != 0 && strcmp(s, "..") != 0)
+            break;
+    }
+    int n = strlen(fd[h].cFileName);
+    if ((fd[h].dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+        fd[h].cFileName[n++] = '/';
+    int i = 0;
+    for (; i < n && i < len; i++)
+        adr[i] = fd[h].cFileName[i];
+    if (i < len)
+        adr[i] = 0;
+    return n;
+}
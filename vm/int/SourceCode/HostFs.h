@@ -0,0 +1,52 @@
+//////////////////////////////////////////////////////////////////////////////
+// HostFs.h  host directory access for the guest (io4)
+//
+// Names are relative to the directory given with -host:dir, "/" or "\"
+// separate subdirectories, ".." and drive letters are refused.
+// All operations return a negative Win32 error code on failure.
+
+#pragma once
+
+
+enum // io4 operations
+{
+    hostOpen    = 1,    // name, len, mode (0 read, 1 create) -> handle
+    hostClose   = 2,    // handle                             -> 0
+    hostRead    = 3,    // handle, adr, len                   -> bytes
+    hostWrite   = 4,    // handle, adr, len                   -> bytes
+    hostSize    = 5,    // handle                             -> bytes
+    hostOpenDir = 6,    // pattern, len ("" = all)            -> handle
+    hostReadDir = 7     // handle, adr, len -> name length, 0 at the end
+                        //                     directories end with "/"
+};
+
+
+class HOSTFS
+{
+public:
+    HOSTFS();
+    virtual ~HOSTFS();
+
+    bool SetRoot(const char* szDir);
+    bool Enabled();
+
+    int Open   (const byte* name, int len, int mode);
+    int Close  (int h);
+    int Read   (int h, byte* adr, int len);
+    int Write  (int h, const byte* adr, int len);
+    int Size   (int h);
+    int OpenDir(const byte* pattern, int len);
+    int ReadDir(int h, byte* adr, int len);
+private:
+    enum { N = 16 };
+    HANDLE  hFile[N];
+    bool    bDir[N];
+    bool    bFirst[N];      // fd[h] holds an entry not returned yet
+    WIN32_FIND_DATA fd[N];
+    char    szRoot[MAX_PATH];
+
+    bool MakePath(char* szPath, const byte* name, int len);
+    int  Alloc();
+    bool Valid(int h, bool dir);
+    int  Error();
+};
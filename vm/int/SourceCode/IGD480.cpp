@@ -20,6 +20,8 @@ IGD480::IGD480(MEMORY* m, SioMouse* sioMouse, Console* con) :
     dwShift(0),
     dwLock(0xFFFFFFFF),
     nCursor(0),
+    nFrames(0),
+    qwRefreshUs(0),
     mem(*m),
     mx(480/2),
     my(360/2),
@@ -88,7 +90,17 @@ dword IGD480::displayThread()
             trace("dwShift=%08X\n", dwShift);
         }
 //      mem.data[IGD480base + 0x20] &= ~0x01;   // line  sync (not necessary, faster w/o it)
+        LARGE_INTEGER f, t0, t1;
+        ::QueryPerformanceCounter(&t0);
         refresh();
+        ::QueryPerformanceCounter(&t1);
+        ::QueryPerformanceFrequency(&f);
+        qword dt = t1.QuadPart - t0.QuadPart;
+        qword hz = f.QuadPart;
+        for (; hz > 0x7FFFFFFF; hz >>= 1)   // MulDiv() is 32 bit
+            dt >>= 1;
+        qwRefreshUs += MulDiv((int)dt, 1000000, (int)hz);
+        nFrames++;
         ::Sleep(100);
         mem.data[IGD480base + 0x00] &= ~0x01;   // frame sync
 //      mem.data[IGD480base + 0x20] |=  0x01;   // line  sync (not necessary, faster w/o it)
@@ -25,7 +25,7 @@ struct Font
     int w;
     int h;
     int base;
-    int rfe;
+    int rfe;    // bmg 10: words between glyphs of adjacent chars
 };
 
 
@@ -118,6 +118,9 @@ public:
     virtual ~IGD480();
     void shutdown();
 
+    dword frameCount() const { return nFrames; }
+    qword refreshMicroseconds() const { return qwRefreshUs; }
+
 private:
     MEMORY&   mem;
     SioMouse& mouse;
@@ -129,6 +132,8 @@ private:
     dword dwShift;
     dword dwLock;
     int   nCursor;
+    volatile dword nFrames;
+    volatile qword qwRefreshUs;
 
     HWND  hWnd;
     HWND  hStaticWnd;
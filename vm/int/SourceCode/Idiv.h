@@ -0,0 +1,30 @@
+//////////////////////////////////////////////////////////////////////////////
+// Idiv.h  Kronos DIV and MOD on host integers
+//
+// Plain C with no CRT or Win32 types: VM.cpp and vm/idivtest share it.
+
+#pragma once
+
+// Kronos division rounds down, the remainder has the sign of the divisor.
+// This used to be a shift and subtract loop on qlong, the host division
+// with the sign correction gives the same quotient and remainder for all
+// operands (MIN(INTEGER) DIV -1 wraps to MIN(INTEGER) as it did).
+// y must not be 0.
+static int kr_idiv(int x, int y, int* rem)
+{
+    int z, r;
+    if (y == -1)    // the host would trap on MIN(INTEGER) DIV -1
+    {
+        *rem = 0;
+        return (int)(0U - (unsigned int)x);
+    }
+    z = x / y;
+    r = x % y;
+    if (r != 0 && (r ^ y) < 0)
+    {
+        z--;
+        r += y;
+    }
+    *rem = r;
+    return z;
+}
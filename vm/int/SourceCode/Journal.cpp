@@ -0,0 +1,199 @@
+//////////////////////////////////////////////////////////////////////////////
+// Journal.cpp  deterministic record/replay
+
+#include "preCompiled.h"
+#include "Journal.h"
+
+
+JOURNAL::JOURNAL() : mode(modeOff), hFile(INVALID_HANDLE_VALUE), buf(null), n(0), have(0)
+{
+    szWhy[0] = 0;
+}
+
+
+JOURNAL::~JOURNAL()
+{
+    if (hFile != INVALID_HANDLE_VALUE)
+        CloseHandle(hFile);
+    if (buf != null)
+        GlobalFreePtr(buf);
+}
+
+
+bool JOURNAL::Record(const char* szFileName)
+{
+    if (mode != modeOff)
+        return false;
+    buf = (JournalRec*)GlobalAllocPtr(GPTR, Size * sizeof(JournalRec));
+    if (buf == null)
+        return false;
+    hFile = CreateFile(szFileName, GENERIC_WRITE, FILE_SHARE_READ, null,
+                       CREATE_ALWAYS, 0, null);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+    JournalHeader hdr;
+    memcpy(hdr.magic, "KRJOURN1", 8);
+    hdr.recSize = sizeof(JournalRec);
+    dword dw = 0;
+    WriteFile(hFile, &hdr, sizeof hdr, &dw, null);
+    n = 0;
+    mode = modeRecord;
+    return true;
+}
+
+
+bool JOURNAL::Replay(const char* szFileName)
+{
+    if (mode != modeOff)
+        return false;
+    buf = (JournalRec*)GlobalAllocPtr(GPTR, Size * sizeof(JournalRec));
+    if (buf == null)
+        return false;
+    hFile = CreateFile(szFileName, GENERIC_READ, FILE_SHARE_READ, null,
+                       OPEN_EXISTING, 0, null);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+    JournalHeader hdr;
+    dword dw = 0;
+    if (!ReadFile(hFile, &hdr, sizeof hdr, &dw, null) || dw != sizeof hdr ||
+        memcmp(hdr.magic, "KRJOURN1", 8) != 0 || hdr.recSize != sizeof(JournalRec))
+        return false;
+    n = 0;
+    have = 0;
+    mode = modeReplay;
+    return true;
+}
+
+
+void JOURNAL::Close(qword icount)
+{
+    if (mode == modeRecord)
+    {
+        Event(icount, jEnd, 0, 0, 0, 0);
+        Flush();
+    }
+    mode = modeOff;
+    if (hFile != INVALID_HANDLE_VALUE)
+        CloseHandle(hFile);
+    hFile = INVALID_HANDLE_VALUE;
+}
+
+
+void JOURNAL::Flush()
+{
+    dword dw = 0;
+    if (n > 0 && !WriteFile(hFile, buf, n * sizeof(JournalRec), &dw, null))
+    {
+        trace("journal: write failed, recording stopped\n");
+        mode = modeOff;
+    }
+    n = 0;
+}
+
+
+bool JOURNAL::Fill()
+{
+    dword dw = 0;
+    if (!ReadFile(hFile, buf, Size * sizeof(JournalRec), &dw, null))
+        dw = 0;
+    have = dw / sizeof(JournalRec);
+    n = 0;
+    return have > 0;
+}
+
+
+// next record is of this kind and due now
+bool JOURNAL::Peek(int kind, qword icount)
+{
+    if (n == have && !Fill())
+        return false;
+    return buf[n].kind == kind && buf[n].icount == icount;
+}
+
+
+void JOURNAL::Diverged(const char* what, qword icount)
+{
+    if (n < have && buf[n].kind == jEnd && buf[n].icount == icount)
+        wsprintf(szWhy, "replay: end of journal at %08X%08X",
+                 (dword)(icount >> 32), (dword)icount);
+    else
+        wsprintf(szWhy, "replay: %s departs from journal at %08X%08X",
+                 what, (dword)(icount >> 32), (dword)icount);
+    mode = modeOff;
+}
+
+
+bool JOURNAL::NextIpt(qword icount, int& ipt)
+{
+    ipt = 0;
+    if (n == have && !Fill())
+    {
+        Diverged("run", icount);
+        return false;
+    }
+    JournalRec& r = buf[n];
+    if (r.icount > icount)
+        return true;
+    if (r.icount < icount || r.kind == jEnd)
+    {
+        Diverged("run", icount);
+        return false;
+    }
+    if (r.kind != jTimer && r.kind != jIpt)
+        return true;    // taken by the instruction about to run
+    ipt = r.kind == jTimer ? 1 : r.x;
+    n++;
+    return true;
+}
+
+
+bool JOURNAL::Inp(qword icount, int adr, int& data)
+{
+    if (!Peek(jInp, icount) || buf[n].y != (word)adr)
+    {
+        Diverged("INP", icount);
+        return false;
+    }
+    data = buf[n++].v;
+    return true;
+}
+
+
+bool JOURNAL::Time(qword icount, SYSTEMTIME& st)
+{
+    if (!Peek(jTime, icount))
+    {
+        Diverged("time", icount);
+        return false;
+    }
+    JournalRec& r = buf[n++];
+    st.wSecond = r.x;
+    st.wYear   = r.y;
+    st.wMonth  = (word)(r.v >> 8);
+    st.wDay    = (word)(r.v & 0xFF);
+    st.wHour   = (word)(r.w >> 8);
+    st.wMinute = (word)(r.w & 0xFF);
+    return true;
+}
+
+
+bool JOURNAL::Write(qword icount, int dsk, int sec, dword sum)
+{
+    if (!Peek(jWrite, icount) || buf[n].x != (byte)dsk ||
+        buf[n].v != (dword)sec || buf[n].w != sum)
+    {
+        Diverged("disk write", icount);
+        return false;
+    }
+    n++;
+    return true;
+}
+
+
+dword JOURNAL::Checksum(const byte* p, int len)
+{
+    dword sum = 0;
+    for (int i = 0; i < len; i++)
+        sum = (sum << 5 | sum >> 27) ^ p[i];
+    return sum;
+}
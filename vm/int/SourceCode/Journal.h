@@ -0,0 +1,112 @@
+//////////////////////////////////////////////////////////////////////////////
+// Journal.h  deterministic record/replay (-record:file, -replay:file)
+//
+// Everything the guest can see that does not follow from its own
+// instructions is written to the journal together with the number of
+// instructions executed so far (VM::icount):
+//      timer and serial line interrupts at the moment they are taken,
+//      every INP result,
+//      the time of day returned by disk operation 6.
+// Disk writes are journaled with a checksum to check their order.
+//
+// Replay takes these inputs from the journal instead of the timer thread,
+// the lines and the clock, and does not sleep in IDLE, so the run is
+// repeated instruction by instruction at full interpreter speed.  At the
+// end of the journal, or at the first input that does not match it, the
+// VM drops into the debug monitor; 'g' continues with live inputs.
+//
+// Replay must start from copies of the disks as they were when recording
+// started.  Not journaled: host files (io4) and the IGD480 frame sync bit.
+//
+// File: JournalHeader, then records until jEnd.
+
+#pragma once
+
+#pragma pack(push, 1)
+
+struct JournalHeader
+{
+    char  magic[8];     // "KRJOURN1"
+    dword recSize;      // sizeof(JournalRec)
+};
+
+struct JournalRec
+{
+    qword icount;       // instructions executed before the event
+    byte  kind;
+    byte  x;
+    word  y;
+    dword v;
+    dword w;
+};
+
+#pragma pack(pop)
+
+enum // JournalRec.kind     x       y       v               w
+{
+    jTimer  = 1,        //  -       -       -               -
+    jIpt    = 2,        //  Ipt     -       -               -
+    jInp    = 3,        //  -       adr     data            -
+    jTime   = 4,        //  second  year    month<<8|day    hour<<8|minute
+    jWrite  = 5,        //  disk    -       sector          checksum
+    jEnd    = 6         //  -       -       -               -
+};
+
+
+class JOURNAL
+{
+public:
+    JOURNAL();
+    virtual ~JOURNAL();
+
+    bool Record(const char* szFileName);
+    bool Replay(const char* szFileName);
+    void Close(qword icount);   // recording: flush and write jEnd
+
+    inline bool recording() const { return mode == modeRecord; }
+    inline bool replaying() const { return mode == modeReplay; }
+
+    inline void Event(qword icount, int kind, int x, int y, dword v, dword w)
+    {
+        if (mode != modeRecord)
+            return;
+        JournalRec& r = buf[n];
+        r.icount = icount;
+        r.kind   = (byte)kind;
+        r.x      = (byte)x;
+        r.y      = (word)y;
+        r.v      = v;
+        r.w      = w;
+        if (++n == Size)
+            Flush();
+    }
+
+    // replay, all return false when the run departs from the journal:
+    bool NextIpt(qword icount, int& ipt);   // ipt = 0 if none now
+    bool Inp(qword icount, int adr, int& data);
+    bool Time(qword icount, SYSTEMTIME& st);
+    bool Write(qword icount, int dsk, int sec, dword sum);
+
+    const char* Why() const { return szWhy; }   // why replay stopped
+
+    static dword Checksum(const byte* p, int len);
+
+private:
+    enum
+    {
+        Size = 4 * K    // records buffered
+    };
+    enum { modeOff, modeRecord, modeReplay };
+
+    void Flush();
+    bool Fill();
+    bool Peek(int kind, qword icount);
+    void Diverged(const char* what, qword icount);
+
+    int         mode;
+    HANDLE      hFile;
+    JournalRec* buf;
+    int         n;      // records in buf (recording) or used (replay)
+    int         have;   // replay: records read into buf
+    char        szWhy[80];
+};
@@ -1,10 +1,17 @@
 #include "preCompiled.h"
 #include "Disks.h"
+#include "HostFs.h"
 #include "Memory.h"
 #include "Memory.h"
 #include "vmConsole.h"
 #include "IGD480.h"
 #include "SIO_TCP.h"
+#include "Tracer.h"
+#include "Journal.h"
+#include "Breaks.h"
+#include "Gdb.h"
+#include "Metrics.h"
+#include "Lockstep.h"
 #include "VM.h"
 
 
@@ -44,6 +51,8 @@ void AddDisks(VM& vm)
     {
         char* q = skipword(p);
         if (q != null && *q != 0) { *q = 0; q++; }
+        if (*p == '-' || (*p == '"' && p[1] == '-'))
+            p += strlen(p); // option, see ParseOptions()
         if (*p == '"') p++;
         if (strlen(p) > 0 && p[strlen(p)-1] == '"') p[strlen(p)-1] = 0;
         if (strlen(p) > 0)
@@ -58,16 +67,143 @@ void AddDisks(VM& vm)
     }
 }
 
+// Kronos3vm.exe -lines:N ...  number of telnet lines (default 8)
+// Kronos3vm.exe -host:dir ... directory the guest may access via io4
+// Kronos3vm.exe -trace:file . binary execution trace, see Tracer.h
+// Kronos3vm.exe -record:file  journal of nondeterministic inputs, see Journal.h
+// Kronos3vm.exe -replay:file  repeat a recorded run
+// Kronos3vm.exe -gdb:port ... GDB remote protocol on 127.0.0.1:port, see Gdb.h
+// Kronos3vm.exe -metrics:port  counters over http on 127.0.0.1:port, see Metrics.h
+// Kronos3vm.exe -boot:file .. run a boot image (excelsior/src/boot/*.boot)
+//                             headless: no disks needed, no keyboard waits,
+//                             the process exit code is VM::ExitCode()
+// Kronos3vm.exe -capture:file  copy of the guest console output
+// Kronos3vm.exe -until:text . stop with exit code 0 once the guest console
+//                             printed text (see vm/run-tests.bat)
+// Kronos3vm.exe -states:file  machine states of a reference run, see Lockstep.h
+// Kronos3vm.exe -lockstep:file  compare with the states of a reference run
+// Kronos3vm.exe -every:N .... state every N instructions (default 1000)
+// Kronos3vm.exe -every:call . state after calls, returns and transfers
+// Kronos3vm.exe -timeout:sec  give up a headless run, see vm/run-tests.bat
+// Kronos3vm.exe -reals:strict  Kronos real format and traps, exact results
+//                             rounded half away from zero (a model, see VM.cpp)
+// Kronos3vm.exe -reals:fast . host floats (default)
+
+enum
+{
+    defLines = 8,
+    maxLines = 23   // line 23 uses ipt 0x3C/0x3D, 0x3F and up are shared
+};
+
+int  nLines = defLines;
+char szHost[MAX_PATH];
+char szTrace[MAX_PATH];
+char szRecord[MAX_PATH];
+char szReplay[MAX_PATH];
+int  nGdbPort = 0;
+int  nMetricsPort = 0;
+char szBoot[MAX_PATH];
+char szCapture[MAX_PATH];
+char szUntil[MAX_PATH];
+int  nTimeout = 0;
+char szStates[MAX_PATH];
+char szLockstep[MAX_PATH];
+int  nEvery = 1000;
+bool bStrictReals = false;
+
+char* skipprefix(const char* pStr, const char* pPrefix)
+{
+    while (*pPrefix != 0 && *pStr == *pPrefix)
+    {
+        pStr++;
+        pPrefix++;
+    }
+    return *pPrefix == 0 ? (char*)pStr : null;
+}
+
+
+// -name:path or "-name:path" or -name:"path"
+bool optpath(const char* p, const char* pName, char* szPath)
+{
+    const char* q = skipword(p);
+    const char* d = skipprefix(*p == '"' ? p + 1 : p, pName);
+    if (d == null || q == null)
+        return false;
+    int n = 0;
+    for (; d < q && n < MAX_PATH - 1; d++)
+    {
+        if (*d != '"')
+            szPath[n++] = *d;
+    }
+    szPath[n] = 0;
+    return true;
+}
+
+
+// -name:port
+bool optport(const char* p, const char* pName, int& nPort)
+{
+    const char* d = skipprefix(p, pName);
+    if (d == null)
+        return false;
+    int n = 0;
+    for (; *d >= '0' && *d <= '9' && n <= 0xFFFF; d++)
+        n = n * 10 + (*d - '0');
+    nPort = n <= 0xFFFF ? n : 0;
+    return true;
+}
+
+
+void ParseOptions()
+{
+    char* p = skipspaces(skipword(GetCommandLine()));
+    while (p != null && *p != 0)
+    {
+        optpath(p, "-host:", szHost);
+        optpath(p, "-trace:", szTrace);
+        optpath(p, "-record:", szRecord);
+        optpath(p, "-replay:", szReplay);
+        optpath(p, "-boot:", szBoot);
+        optpath(p, "-capture:", szCapture);
+        optpath(p, "-until:", szUntil);
+        optpath(p, "-states:", szStates);
+        optpath(p, "-lockstep:", szLockstep);
+        char* d = skipprefix(p, "-lines:");
+        if (d != null)
+        {
+            int n = 0;
+            for (; *d >= '0' && *d <= '9' && n <= maxLines; d++)
+                n = n * 10 + (*d - '0');
+            nLines = n > maxLines ? maxLines : n;
+        }
+        d = skipprefix(p, "-every:");
+        if (d != null)
+        {
+            int n = 0;
+            for (; *d >= '0' && *d <= '9' && n < 0x7FFFFFF; d++)
+                n = n * 10 + (*d - '0');
+            nEvery = skipprefix(d, "call") != null ? 0 : n > 0 ? n : 1;
+        }
+        d = skipprefix(p, "-reals:");
+        if (d != null)
+            bStrictReals = skipprefix(d, "strict") != null;
+        optport(p, "-gdb:", nGdbPort);
+        optport(p, "-metrics:", nMetricsPort);
+        optport(p, "-timeout:", nTimeout);
+        p = skipspaces(skipword(p));
+    }
+}
+
+
 Console con(0xFB8, 0x0C);
 
-SioTcp sio1(0xFBC, 0x0E);   // 1 177570b  70b
-SioTcp sio2(0xFC0, 0x10);   // 2 177600b 100b
-SioTcp sio3(0xFC4, 0x12);   // 3 177610b 110b
-SioTcp sio4(0xFC8, 0x14);   // 4 177620b 120b
-SioTcp sio5(0xFCC, 0x16);   // 5 177630b 130b
-SioTcp sio6(0xFD0, 0x18);   // 6 177640b 140b
-SioTcp sio7(0xFD4, 0x1A);   // 7 177650b 150b
-SioTcp sio8(0xFD8, 0x1C);   // 8 177660b 160b
+// sio1..sio8:
+//  0xFBC, 0x0E    1 177570b  70b
+//  ...
+//  0xFD8, 0x1C    8 177660b 160b
+// sio9 and up go down from the console:
+//  0xFB4, 0x20    9 177550b 200b
+//  0xFB0, 0x22   10 177540b 210b ...
 
 SioMouse mouse(0xFDC, 0x1E);    // 0 177670b 170b
 
@@ -78,29 +214,104 @@ void AddConsole(VM &vm)
     vm.setConsole(&con);
     vm.sios.addSIO(&con);
 
-    vm.sios.addSIO(&sio1);
-    vm.sios.addSIO(&sio2);
-    vm.sios.addSIO(&sio3);
-    vm.sios.addSIO(&sio4);
-    vm.sios.addSIO(&sio5);
-    vm.sios.addSIO(&sio6);
-    vm.sios.addSIO(&sio7);
-    vm.sios.addSIO(&sio8);
+    for (int i = 1; i <= nLines; i++)
+    {
+        int addr = i <= 8 ? 0xFB8 + 4 * i : 0xFB8 - 4 * (i - 8);
+        int ipt  = i <= 8 ? 0x0C + 2 * i  : 0x20 + 2 * (i - 9);
+        SioTcp *sio = new SioTcp(addr, ipt);
+        if (sio == null)
+            break;
+        vm.sios.addSIO(sio);
+        server.addClient(sio);
+    }
     vm.sios.addSIO(&mouse);
 
-    server.addClient(&sio1);
-    server.addClient(&sio2);
-    server.addClient(&sio3);
-    server.addClient(&sio4);
-    server.addClient(&sio5);
-    server.addClient(&sio6);
-    server.addClient(&sio7);
-    server.addClient(&sio8);
-
     server.start();
 }
 
 
+void AddHost(VM& vm)
+{
+    if (szHost[0] == 0)
+        return;
+    if (!vm.Host.SetRoot(szHost))
+        vm.printf("failed to use host directory \"%s\"\n", szHost);
+    else
+        vm.printf("host \"%s\"\n", szHost);
+}
+
+
+void AddTrace(VM& vm)
+{
+    if (szTrace[0] == 0)
+        return;
+    if (!vm.Trace.Open(szTrace))
+        vm.printf("failed to start trace \"%s\"\n", szTrace);
+    else
+        vm.printf("trace \"%s\"\n", szTrace);
+}
+
+
+void AddJournal(VM& vm)
+{
+    if (szReplay[0] != 0)
+    {
+        if (!vm.Journal.Replay(szReplay))
+            vm.printf("failed to replay \"%s\"\n", szReplay);
+        else
+            vm.printf("replay \"%s\"\n", szReplay);
+    }
+    else if (szRecord[0] != 0)
+    {
+        if (!vm.Journal.Record(szRecord))
+            vm.printf("failed to record \"%s\"\n", szRecord);
+        else
+            vm.printf("record \"%s\"\n", szRecord);
+    }
+}
+
+
+void AddGdb(VM& vm)
+{
+    if (nGdbPort == 0)
+        return;
+    if (!vm.Gdb.Open(nGdbPort))
+        vm.printf("failed to listen for gdb on port %d\n", nGdbPort);
+    else
+        vm.printf("gdb port %d\n", nGdbPort);
+}
+
+
+void AddMetrics(VM& vm)
+{
+    if (nMetricsPort == 0)
+        return;
+    if (!vm.Metrics.Open(nMetricsPort, &vm.igd))
+        vm.printf("failed to serve metrics on port %d\n", nMetricsPort);
+    else
+        vm.printf("metrics port %d\n", nMetricsPort);
+}
+
+
+void AddLockstep(VM& vm)
+{
+    if (szLockstep[0] != 0)
+    {
+        if (!vm.Lockstep.Compare(szLockstep))
+            vm.printf("failed to compare with states \"%s\"\n", szLockstep);
+        else
+            vm.printf("lockstep \"%s\"\n", szLockstep);
+    }
+    else if (szStates[0] != 0)
+    {
+        if (!vm.Lockstep.Write(szStates, nEvery))
+            vm.printf("failed to write states \"%s\"\n", szStates);
+        else
+            vm.printf("states \"%s\"\n", szStates);
+    }
+}
+
+
 bool ReadBooter(VM& vm)
 {
     vm.Disks.Mount(1);
@@ -108,6 +319,45 @@ bool ReadBooter(VM& vm)
 }
 
 
+// boot images are memory dumps from address 0, word 1 is the first process
+bool ReadBootImage(VM& vm, const char* szFile)
+{
+    HANDLE h = CreateFile(szFile, GENERIC_READ, FILE_SHARE_READ, null,
+                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, null);
+    if (h == INVALID_HANDLE_VALUE)
+        return false;
+    dword size = GetFileSize(h, null);
+    dword n = 0;
+    bool ok = size >= 8 && size <= dword(vm.mem.GetSize()) * 4 &&
+              ReadFile(h, &vm.mem[0], size, &n, null) && n == size;
+    CloseHandle(h);
+    return ok;
+}
+
+
+int RunBootImage(VM& vm)
+{
+    if (!ReadBootImage(vm, szBoot))
+    {
+        vm.printf("failed to read boot image \"%s\"\n", szBoot);
+        return 2;
+    }
+    if (szCapture[0] != 0 && !vm.Capture(szCapture))
+    {
+        vm.printf("failed to capture console to \"%s\"\n", szCapture);
+        return 2;
+    }
+    vm.Headless(nTimeout);
+    vm.Until(szUntil);
+    vm.Run();
+    vm.Trace.Dump();
+    vm.Journal.Close(vm.Instructions());
+    vm.Lockstep.Close();
+    vm.printf("Kronos stopped, exit code %d\n", vm.ExitCode());
+    return vm.ExitCode();
+}
+
+
 int main()
 {
     // we do not want Abort|Retry|Ignore - do we?
@@ -116,9 +366,19 @@ int main()
     const int MemorySize = 1024*K; // 1M dword = 4MB
     VM vm(MemorySize*4, &mouse, &con);
 
+    ParseOptions();
+    vm.StrictReals(bStrictReals);
     AddConsole(vm);
     AddDisks(vm);
+    AddHost(vm);
+    AddTrace(vm);
+    AddJournal(vm);
+    AddGdb(vm);
+    AddMetrics(vm);
+    AddLockstep(vm);
 
+    if (szBoot[0] != 0)
+        return RunBootImage(vm);
     if (vm.Disks.GetCount() == 0)
     {
         vm.printf("Kronos3vm.exe \"XD0.dsk\" \"XD1.dsk\" ...\n");
@@ -134,6 +394,9 @@ int main()
         return 2;
     }
     vm.Run();
+    vm.Trace.Dump();
+    vm.Journal.Close(vm.Instructions());
+    vm.Lockstep.Close();
     vm.printf("Kronos stopped\n");
     while (vm.busyRead() == 0)
         Sleep(100);
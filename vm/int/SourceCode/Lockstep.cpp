@@ -0,0 +1,245 @@
+//////////////////////////////////////////////////////////////////////////////
+// Lockstep.cpp  differential runs
+
+#include "preCompiled.h"
+#include "Memory.h"
+#include "Journal.h"
+#include "Lockstep.h"
+
+
+LOCKSTEP::LOCKSTEP() :
+    mem(null), on(false), comparing(false), boundary(false), every(1), next(0),
+    hFile(INVALID_HANDLE_VALUE), buf(null), n(0), have(0),
+    pages(null), sums(null), refSums(null)
+{
+    memset(&ref, 0, sizeof ref);
+    memset(&prev, 0, sizeof prev);
+    szWhy[0] = 0;
+}
+
+
+LOCKSTEP::~LOCKSTEP()
+{
+    Close();
+    if (buf != null)
+        GlobalFreePtr(buf);
+    if (pages != null)
+        GlobalFreePtr(pages);
+    if (sums != null)
+        GlobalFreePtr(sums);
+    if (refSums != null)
+        GlobalFreePtr(refSums);
+}
+
+
+void LOCKSTEP::Attach(MEMORY* m)
+{
+    mem = m;
+}
+
+
+bool LOCKSTEP::Write(const char* szFileName, int nEvery)
+{
+    if (on || nEvery < 0)
+        return false;
+    buf     = (byte*)GlobalAllocPtr(GPTR, Size);
+    pages   = (int*)GlobalAllocPtr(GPTR, maxPages * sizeof(int));
+    sums    = (StepPage*)GlobalAllocPtr(GPTR, maxPages * sizeof(StepPage));
+    refSums = (StepPage*)GlobalAllocPtr(GPTR, maxPages * sizeof(StepPage));
+    if (buf == null || pages == null || sums == null || refSums == null)
+        return false;
+    hFile = CreateFile(szFileName, GENERIC_WRITE, FILE_SHARE_READ, null,
+                       CREATE_ALWAYS, 0, null);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+    LockstepHeader hdr;
+    memcpy(hdr.magic, "KRSTEPS1", 8);
+    hdr.recSize = sizeof(StepRec);
+    hdr.every   = nEvery;
+    every = nEvery;
+    n = 0;
+    Put(&hdr, sizeof hdr);
+    mem->Dirty(pages, maxPages);    // the first state has every page written so far
+    next = 0;
+    comparing = false;
+    on = true;
+    return true;
+}
+
+
+bool LOCKSTEP::Compare(const char* szFileName)
+{
+    if (on)
+        return false;
+    buf     = (byte*)GlobalAllocPtr(GPTR, Size);
+    pages   = (int*)GlobalAllocPtr(GPTR, maxPages * sizeof(int));
+    sums    = (StepPage*)GlobalAllocPtr(GPTR, maxPages * sizeof(StepPage));
+    refSums = (StepPage*)GlobalAllocPtr(GPTR, maxPages * sizeof(StepPage));
+    if (buf == null || pages == null || sums == null || refSums == null)
+        return false;
+    hFile = CreateFile(szFileName, GENERIC_READ, FILE_SHARE_READ, null,
+                       OPEN_EXISTING, 0, null);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+    n = 0;
+    have = 0;
+    LockstepHeader hdr;
+    if (!Get(&hdr, sizeof hdr) || memcmp(hdr.magic, "KRSTEPS1", 8) != 0 ||
+        hdr.recSize != sizeof(StepRec) || int(hdr.every) < 0)
+        return false;
+    every = hdr.every;
+    mem->Dirty(pages, maxPages);
+    next = 0;
+    comparing = true;
+    on = true;
+    return true;
+}
+
+
+void LOCKSTEP::Close()
+{
+    if (on && !comparing && n > 0)
+    {
+        dword dw = 0;
+        WriteFile(hFile, buf, n, &dw, null);
+    }
+    on = false;
+    if (hFile != INVALID_HANDLE_VALUE)
+        CloseHandle(hFile);
+    hFile = INVALID_HANDLE_VALUE;
+}
+
+
+bool LOCKSTEP::Put(const void* p, int len)
+{
+    if (n + len > Size)
+    {
+        dword dw = 0;
+        if (!WriteFile(hFile, buf, n, &dw, null) || dw != dword(n))
+        {
+            trace("lockstep: write failed, states stopped\n");
+            on = false;
+            return false;
+        }
+        n = 0;
+    }
+    memcpy(buf + n, p, len);
+    n += len;
+    return true;
+}
+
+
+bool LOCKSTEP::Get(void* p, int len)
+{
+    byte* q = (byte*)p;
+    while (len > 0)
+    {
+        if (n == have)
+        {
+            dword dw = 0;
+            if (!ReadFile(hFile, buf, Size, &dw, null) || dw == 0)
+                return false;
+            have = dw;
+            n = 0;
+        }
+        int k = have - n < len ? have - n : len;
+        memcpy(q, buf + n, k);
+        n += k;
+        q += k;
+        len -= k;
+    }
+    return true;
+}
+
+
+void LOCKSTEP::Diverged(const char* fmt, ...)
+{
+    va_list vl;
+    va_start(vl, fmt);
+    wvsprintf(szWhy, fmt, vl);
+    va_end(vl);
+    on = false;
+}
+
+
+bool LOCKSTEP::Step(StepRec& now)
+{
+    boundary = false;
+    next = every > 0 ? now.icount + every : ~qword(0);
+    int k = mem->Dirty(pages, maxPages);
+    if (k < 0)
+        k = 0;  // no write watch: registers only
+    for (int i = 0; i < k; i++)
+    {
+        sums[i].page = pages[i];
+        sums[i].sum  = JOURNAL::Checksum(&(*mem)[pages[i] * MEMORY::PageWords],
+                                         MEMORY::PageWords * 4);
+    }
+    now.pages = k;
+    if (!comparing)
+    {
+        prev = now;
+        return Put(&now, sizeof now) && Put(sums, k * sizeof(StepPage));
+    }
+
+    if (!Get(&ref, sizeof ref) || ref.pages > maxPages ||
+        !Get(refSums, ref.pages * sizeof(StepPage)))
+    {
+        Diverged("lockstep: states file ends at %08X%08X",
+                 (dword)(now.icount >> 32), (dword)now.icount);
+        return false;
+    }
+    if (ref.icount != now.icount)
+    {
+        Diverged("lockstep: state taken at %08X%08X, the reference took it at %08X%08X",
+                 (dword)(now.icount >> 32), (dword)now.icount,
+                 (dword)(ref.icount >> 32), (dword)ref.icount);
+        return false;
+    }
+    static const char* szReg[] = { "PC", "F", "G", "L", "S", "H", "P", "M", "sp" };
+    const dword* a = &now.PC;
+    const dword* b = &ref.PC;
+    for (int r = 0; r < 9; r++)
+    {
+        if (a[r] != b[r])
+        {
+            Diverged("lockstep: %s is %08X, expected %08X", szReg[r], a[r], b[r]);
+            return false;
+        }
+    }
+    for (dword s = 0; s < now.sp && s < 16; s++)
+    {
+        if (now.AStack[s] != ref.AStack[s])
+        {
+            Diverged("lockstep: A-stack[%d] is %08X, expected %08X", s, now.AStack[s], ref.AStack[s]);
+            return false;
+        }
+    }
+    // both lists are in address order
+    int x = 0;
+    int y = 0;
+    while (x < k || y < int(ref.pages))
+    {
+        if (y == int(ref.pages) || (x < k && sums[x].page < refSums[y].page))
+        {
+            Diverged("lockstep: page %08X written, the reference did not",
+                     sums[x].page * MEMORY::PageWords);
+            return false;
+        }
+        if (x == k || refSums[y].page < sums[x].page)
+        {
+            Diverged("lockstep: page %08X not written, the reference did",
+                     refSums[y].page * MEMORY::PageWords);
+            return false;
+        }
+        if (sums[x].sum != refSums[y].sum)
+        {
+            Diverged("lockstep: page %08X differs", sums[x].page * MEMORY::PageWords);
+            return false;
+        }
+        x++;
+        y++;
+    }
+    prev = now;
+    return true;
+}
@@ -0,0 +1,104 @@
+//////////////////////////////////////////////////////////////////////////////
+// Lockstep.h  differential runs (-states:file, -lockstep:file, -every:N)
+//
+// Proves that a changed VM executes exactly like the reference build.
+// The reference run writes the machine state every N instructions to the
+// states file; the candidate run takes its own state at the same points,
+// compares and stops at the first difference with both states and the
+// code around PC, see VM::LockstepDiverged().  -every:1 checks every
+// instruction, -every:call only after procedure calls and returns and
+// process transfers (interrupts included).
+//
+// Both runs must see the same inputs: replay one journal (-replay:, see
+// Journal.h) or boot the same headless image (-boot:).
+//
+// State: instructions executed, registers, the A-stack and a checksum of
+// every memory page written since the previous state (host write watch,
+// see MEMORY::Dirty()).  A page written by one run only is a difference
+// too, even if the other run left the same bytes there.
+//
+// File: LockstepHeader, then StepRec records, each followed by
+// StepRec.pages StepPage records.
+
+#pragma once
+
+class MEMORY;
+
+#pragma pack(push, 1)
+
+struct LockstepHeader
+{
+    char  magic[8];     // "KRSTEPS1"
+    dword recSize;      // sizeof(StepRec)
+    dword every;        // instructions, 0 - calls
+};
+
+struct StepRec
+{
+    qword icount;
+    dword PC, F, G, L, S, H, P, M;
+    dword sp;
+    dword AStack[16];   // AStackSize used, the rest is 0
+    dword pages;
+};
+
+struct StepPage
+{
+    dword page;         // MEMORY::PageWords words
+    dword sum;          // JOURNAL::Checksum()
+};
+
+#pragma pack(pop)
+
+
+class LOCKSTEP
+{
+public:
+    LOCKSTEP();
+    virtual ~LOCKSTEP();
+
+    void Attach(MEMORY* m);                         // VM constructor
+    bool Write(const char* szFileName, int every);  // every: 0 - calls
+    bool Compare(const char* szFileName);           // every as written
+    void Close();
+
+    inline bool Due(qword icount) const
+    {
+        return on && (boundary || icount >= next);
+    }
+    inline void Boundary() { boundary = every == 0; }
+
+    bool Step(StepRec& now);    // false: differs, see Why(), Expected()
+
+    const char*    Why() const { return szWhy; }
+    const StepRec& Expected() const { return ref; }
+    const StepRec& Previous() const { return prev; }   // last equal state
+
+private:
+    enum
+    {
+        maxPages = 1024,    // 4MB
+        Size     = 64 * K   // bytes buffered
+    };
+
+    bool Put(const void* p, int len);
+    bool Get(void* p, int len);
+    void Diverged(const char* fmt, ...);
+
+    MEMORY*   mem;
+    bool      on;
+    bool      comparing;
+    bool      boundary;
+    int       every;
+    qword     next;
+    HANDLE    hFile;
+    byte*     buf;
+    int       n;        // bytes in buf (write) or used (compare)
+    int       have;     // compare: bytes read into buf
+    int*      pages;
+    StepPage* sums;
+    StepPage* refSums;
+    StepRec   ref;
+    StepRec   prev;
+    char      szWhy[120];
+};
@@ -1,10 +1,18 @@
 #include "preCompiled.h"
 #include "Memory.h"
 
+// Windows 2000 and up, not in the VC6 headers:
+#define MEM_WRITE_WATCH 0x00200000
+typedef UINT (__stdcall *GetWW)(dword flags, void* base, dword size,
+                                void** adrs, dword* count, dword* granularity);
+
 
 MEMORY::MEMORY(int nMemorySizeBytes) :
     data(null),
-    bOutOfRange(false)
+    bOutOfRange(false),
+    nFault(0),
+    bWriteWatch(true),
+    pDirty(null)
 {
     nMemorySize = (nMemorySizeBytes + 3) / 4;
     
@@ -13,7 +21,12 @@ MEMORY::MEMORY(int nMemorySizeBytes) :
 
     // allocate none commited memory
     byte* pReservered = null;
-    pReservered = (byte*)::VirtualAlloc(null, nSizeWithIGD * 4, MEM_RESERVE, PAGE_READWRITE);
+    pReservered = (byte*)::VirtualAlloc(null, nSizeWithIGD * 4, MEM_RESERVE|MEM_WRITE_WATCH, PAGE_READWRITE);
+    if (pReservered == null)
+    {
+        bWriteWatch = false;
+        pReservered = (byte*)::VirtualAlloc(null, nSizeWithIGD * 4, MEM_RESERVE, PAGE_READWRITE);
+    }
 
     data = (int*)::VirtualAlloc(pReservered, nMemorySize*4, MEM_COMMIT,  PAGE_READWRITE);
     assert(pReservered == (byte*)data);
@@ -35,5 +48,31 @@ MEMORY::~MEMORY()
     if (data != null)
         ::VirtualFree(data, 0, MEM_RELEASE);
     data = null;
+    if (pDirty != null)
+        GlobalFreePtr(pDirty);
+}
+
+
+// page numbers are word addresses / PageWords, IGD480 is not watched
+int MEMORY::Dirty(int* pages, int max)
+{
+    static GetWW get = null;
+    if (get == null && bWriteWatch)
+        get = (GetWW)GetProcAddress(GetModuleHandle("kernel32.dll"), "GetWriteWatch");
+    if (get == null)
+        return -1;
+    int n = (nMemorySize + PageWords - 1) / PageWords;
+    if (pDirty == null)
+        pDirty = (void**)GlobalAllocPtr(GPTR, n * sizeof(void*));
+    if (pDirty == null)
+        return -1;
+    dword count = n;
+    dword granularity = 0;
+    if (get(1, data, n * PageWords * 4, pDirty, &count, &granularity) != 0) // WRITE_WATCH_FLAG_RESET
+        return -1;
+    int k = 0;
+    for (dword i = 0; i < count && k < max; i++)
+        pages[k++] = ((byte*)pDirty[i] - (byte*)data) / (PageWords * 4);
+    return k;
 }
 
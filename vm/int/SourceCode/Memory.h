@@ -27,6 +27,10 @@ public: // IGD480 starts at 8MB. Don't make MemorySize 8MB!
 
     inline int GetSize() const { return nMemorySize; }
 
+    enum { PageWords = 1024 };  // 4K host page
+    // pages written since the last call, -1 if the host can not tell
+    int Dirty(int* pages, int max);
+
     private: class reference; public:
 
     inline
@@ -40,6 +44,14 @@ public: // IGD480 starts at 8MB. Don't make MemorySize 8MB!
         return bWasOutOfRange; 
     }
 
+    // block access for the string and move instructions: how many words
+    // from adr on are in the same piece of memory (up to n), the host
+    // pointer to them, and Fault() for the first word that is not
+    inline int  Valid(int adr, int n) const;
+    inline int* Words(int adr) { return &data[adr & ~0xC0000000]; }
+    inline void Fault(int adr) { bOutOfRange = true; nFault = adr; }
+    inline int  FaultAddress() const { return nFault; }   // last one
+
 private:
     class reference // see notes below
     {
@@ -60,6 +72,9 @@ private:
     int* data;
     int  nMemorySize;
     bool bOutOfRange;
+    int  nFault;
+    bool bWriteWatch;
+    void** pDirty;      // Dirty() scratch
 };
 
 
@@ -84,11 +99,24 @@ MEMORY::reference MEMORY::operator[](int n)
     {
 //      trace("MEMORY.OutOfRange 0x%08x\n", n);
         bOutOfRange = true;
+        nFault = n;
         return reference(null, this);
     }
 }
 
 
+inline int MEMORY::Valid(int adr, int n) const
+{
+    adr &= ~0xC0000000;
+    int lim = adr;
+    if (adr < nMemorySize)
+        lim = nMemorySize;
+    else if (adr >= IGD480base && adr <= IGD480base + IGD480offset + IGD480size)
+        lim = IGD480base + IGD480offset + IGD480size + 1;
+    return lim - adr < n ? lim - adr : n;
+}
+
+
 inline void MEMORY::reference::operator=(int i)
 {
     if (p == null)
@@ -0,0 +1,228 @@
+//////////////////////////////////////////////////////////////////////////////
+// Metrics.cpp  counters for monitoring
+
+#include "preCompiled.h"
+#include <winsock2.h>
+#include "Memory.h"
+#include "IGD480.h"
+#include "Metrics.h"
+
+
+METRICS::METRICS() :
+    igd(null), listener((dword)-1), thread(0), start(GetTickCount()),
+    windowStart(GetTickCount()), windowIcount(0), windowIdle(0), reply(null)
+{
+    timerLost = 0;
+    memset(&local, 0, sizeof local);
+    memset(&shared, 0, sizeof shared);
+    InitializeCriticalSection(&cs);
+}
+
+
+METRICS::~METRICS()
+{
+    if (thread != 0)
+        TerminateThread((HANDLE)thread, 0);
+    if (listener != (dword)-1)
+        closesocket(listener);
+    if (reply != null)
+        GlobalFreePtr(reply);
+    DeleteCriticalSection(&cs);
+}
+
+
+void METRICS::Checkpoint(qword icount)
+{
+    local.instructions = icount;
+    dword now = GetTickCount();
+    dword ms = now - windowStart;
+    if (ms >= 1000)
+    {
+        local.ips = MulDiv((int)(dword)(icount - windowIcount), 1000, ms);
+        local.idlePermille = MulDiv((int)(dword)(local.idleMs - windowIdle), 1000, ms);
+        windowStart  = now;
+        windowIcount = icount;
+        windowIdle   = local.idleMs;
+    }
+    if (listener == (dword)-1)
+        return;
+    EnterCriticalSection(&cs);
+    memcpy(&shared, &local, sizeof shared);
+    LeaveCriticalSection(&cs);
+}
+
+
+static dword WINAPI MetricsThread(void *param)
+{
+    return ((METRICS*)param)->Worker();
+}
+
+
+// winsock is started by SioTcps::start()
+bool METRICS::Open(int port, IGD480* pIgd)
+{
+    reply = (char*)GlobalAllocPtr(GPTR, maxReply);
+    if (reply == null)
+        return false;
+    SOCKET so = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (so == INVALID_SOCKET)
+        return false;
+
+    SOCKADDR_IN sin;
+    sin.sin_family = AF_INET;
+    sin.sin_port   = htons((word)port);
+    sin.sin_addr.S_un.S_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(so, (SOCKADDR *)&sin, sizeof(sin)) != 0 || listen(so, SOMAXCONN) != 0)
+    {
+        closesocket(so);
+        return false;
+    }
+    listener = so;
+    igd = pIgd;
+    dword id = 0;
+    thread = (dword)CreateThread(NULL, 4096, MetricsThread, (void *)this, 0, &id);
+    return thread != NULL;
+}
+
+
+// one request per connection, whatever is asked for gets the counters;
+// a silent client gets them too, once the receive timeout has passed
+dword METRICS::Worker()
+{
+    for (;;)
+    {
+        SOCKADDR_IN sin;
+        int len = sizeof(sin);
+        SOCKET so = accept(listener, (SOCKADDR *)&sin, &len);
+        if (so == INVALID_SOCKET)
+            return WSAGetLastError();
+        // a client that connects and sends nothing must not hold up
+        // the scrapes behind it: give up on the request after 1 sec
+        int timeout = 1000;
+        setsockopt(so, SOL_SOCKET, SO_RCVTIMEO, (char *)&timeout, sizeof(timeout));
+        char req[1024];
+        recv(so, req, sizeof req, 0);
+
+        char head[128];
+        char* body = reply + sizeof head;
+        int n = Format(body);
+        int h = wsprintf(head, "HTTP/1.0 200 OK\r\n"
+                               "Content-Type: text/plain; version=0.0.4\r\n"
+                               "Content-Length: %d\r\n\r\n", n);
+        memcpy(body - h, head, h);
+        send(so, body - h, h + n, 0);
+        closesocket(so);
+    }
+}
+
+
+// qword to decimal, without the 64 bit division the CRT would provide
+static char* qtoa(char* s, qword q)
+{
+    char digits[24];
+    int n = 0;
+    do
+    {
+        dword hi = (dword)(q >> 32);
+        dword lo = (dword)q;
+        dword r  = hi % 10;
+        hi /= 10;
+        dword x  = (r << 16) | (lo >> 16);
+        dword q1 = x / 10;
+        dword y  = ((x % 10) << 16) | (lo & 0xFFFF);
+        dword q2 = y / 10;
+        digits[n++] = (char)('0' + y % 10);
+        q = ((qword)hi << 32) | (q1 << 16) | q2;
+    }
+    while (q != 0);
+    while (n > 0)
+        *s++ = digits[--n];
+    *s = 0;
+    return s;
+}
+
+
+static char* metric(char* s, const char* name, const char* labels, qword v)
+{
+    s += wsprintf(s, "%s%s ", name, labels);
+    s = qtoa(s, v);
+    *s++ = '\n';
+    return s;
+}
+
+
+static char* help(char* s, const char* name, const char* type, const char* text)
+{
+    return s + wsprintf(s, "# HELP %s %s\n# TYPE %s %s\n", name, text, name, type);
+}
+
+
+int METRICS::Format(char* buf)
+{
+    static VmCounters c;
+    EnterCriticalSection(&cs);
+    memcpy(&c, &shared, sizeof c);
+    LeaveCriticalSection(&cs);
+
+    char* s = buf;
+    char labels[64];
+
+    s = help(s, "kronos_instructions_total", "counter", "Guest instructions executed.");
+    s = metric(s, "kronos_instructions_total", "", c.instructions);
+    s = help(s, "kronos_instructions_per_second", "gauge", "Guest instructions in the last second.");
+    s = metric(s, "kronos_instructions_per_second", "", c.ips);
+
+    s = help(s, "kronos_traps_total", "counter", "Interrupts and traps taken, by Ipt.");
+    for (int i = 0; i < 256; i++)
+    {
+        if (c.traps[i] == 0)
+            continue;
+        wsprintf(labels, "{ipt=\"%02X\"}", i);
+        s = metric(s, "kronos_traps_total", labels, c.traps[i]);
+    }
+
+    s = help(s, "kronos_timer_ticks_total", "counter", "20ms timer ticks taken by the guest or lost.");
+    s = metric(s, "kronos_timer_ticks_total", "{state=\"taken\"}", c.timerTaken);
+    s = metric(s, "kronos_timer_ticks_total", "{state=\"lost\"}", timerLost);
+
+    s = help(s, "kronos_disk_operations_total", "counter", "io2 operations by disk.");
+    for (int d = 0; d < VmCounters::Disks; d++)
+    {
+        if (c.diskOps[d] == 0)
+            continue;
+        wsprintf(labels, "{disk=\"%d\"}", d);
+        s = metric(s, "kronos_disk_operations_total", labels, c.diskOps[d]);
+        wsprintf(labels, "{disk=\"%d\",dir=\"read\"}", d);
+        s = metric(s, "kronos_disk_bytes_total", labels, c.diskRead[d]);
+        wsprintf(labels, "{disk=\"%d\",dir=\"write\"}", d);
+        s = metric(s, "kronos_disk_bytes_total", labels, c.diskWritten[d]);
+    }
+
+    s = help(s, "kronos_sio_bytes_total", "counter", "Serial line bytes by line address.");
+    for (int l = 0; l < VmCounters::Lines; l++)
+    {
+        if (c.sioIn[l] == 0 && c.sioOut[l] == 0)
+            continue;
+        wsprintf(labels, "{line=\"%03X\",dir=\"in\"}", 0xC00 | (l << 2));
+        s = metric(s, "kronos_sio_bytes_total", labels, c.sioIn[l]);
+        wsprintf(labels, "{line=\"%03X\",dir=\"out\"}", 0xC00 | (l << 2));
+        s = metric(s, "kronos_sio_bytes_total", labels, c.sioOut[l]);
+    }
+
+    s = help(s, "kronos_idle_milliseconds_total", "counter", "Time spent in IDLE.");
+    s = metric(s, "kronos_idle_milliseconds_total", "", c.idleMs);
+    s = help(s, "kronos_idle_ratio", "gauge", "Share of the last second spent in IDLE.");
+    s += wsprintf(s, "kronos_idle_ratio %d.%03d\n", c.idlePermille / 1000, c.idlePermille % 1000);
+    s = help(s, "kronos_uptime_milliseconds", "counter", "Time since start.");
+    s = metric(s, "kronos_uptime_milliseconds", "", GetTickCount() - start);
+
+    if (igd != null)
+    {
+        s = help(s, "kronos_igd_frames_total", "counter", "IGD480 frames refreshed.");
+        s = metric(s, "kronos_igd_frames_total", "", igd->frameCount());
+        s = help(s, "kronos_igd_refresh_microseconds_total", "counter", "Time spent refreshing IGD480 frames.");
+        s = metric(s, "kronos_igd_refresh_microseconds_total", "", igd->refreshMicroseconds());
+    }
+    return s - buf;
+}
@@ -0,0 +1,62 @@
+//////////////////////////////////////////////////////////////////////////////
+// Metrics.h  counters for monitoring (-metrics:port)
+//
+// GET http://127.0.0.1:port/ returns the counters in Prometheus text
+// format.  The VM thread counts into "local" with plain increments and
+// copies it to "shared" at checkpoints (timer interrupt taken, IDLE), the
+// timer and display threads keep their own counters.  Nothing is counted
+// per instruction: the instruction total is VM::icount.
+
+#pragma once
+
+class IGD480;
+
+struct VmCounters
+{
+    enum { Disks = 32, Lines = 256 };
+
+    qword instructions;
+    qword timerTaken;
+    qword idleMs;
+    qword traps[256];           // by Ipt
+    qword diskOps[Disks];
+    qword diskRead[Disks];      // bytes
+    qword diskWritten[Disks];
+    qword sioIn[Lines];         // by (ioAddr >> 2) & 0xFF
+    qword sioOut[Lines];
+    dword ips;                  // instructions per second, last second
+    dword idlePermille;         // of the last second
+};
+
+
+class METRICS
+{
+public:
+    METRICS();
+    virtual ~METRICS();
+
+    bool Open(int port, IGD480* igd);
+
+    VmCounters local;           // VM thread only
+    volatile dword timerLost;   // timer thread only: tick found pending
+
+    void Checkpoint(qword icount);  // VM thread
+
+    dword Worker();
+
+private:
+    enum { maxReply = 64 * K };
+
+    VmCounters shared;
+    CRITICAL_SECTION cs;
+    IGD480* igd;
+    dword listener;
+    dword thread;
+    dword start;                // GetTickCount()
+    dword windowStart;
+    qword windowIcount;
+    qword windowIdle;
+    char* reply;
+
+    int  Format(char* s);
+};
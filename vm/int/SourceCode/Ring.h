@@ -0,0 +1,103 @@
+//////////////////////////////////////////////////////////////////////////////
+// Ring.h  lock free byte queue for exactly one producer thread and
+//         exactly one consumer thread (e.g. network thread and VM thread)
+//
+// nIn is only written by the producer, nOut only by the consumer.
+// Both are free running counters, Size must be a power of 2.
+#pragma once
+
+#include "SIO.h"  // EMPTY
+
+class Ring
+{
+public:
+    enum { Size = 16 * K };
+
+    Ring() : nIn(0), nOut(0) {}
+
+    inline int  count() const { return nIn - nOut; }
+    inline int  space() const { return Size - count(); }
+    inline void reset()       { nIn = 0; nOut = 0; }    // both sides idle
+
+    // producer:
+    inline bool put(byte b);
+    inline int  put(const byte* p, int n);  // returns bytes queued
+    inline byte* span(int& n);              // contiguous free space
+    inline void  commit(int n);             // n bytes written to span()
+
+    // consumer:
+    inline int  get();                      // EMPTY if none
+    inline const byte* data(int& n);        // contiguous queued bytes
+    inline void consume(int n);             // n bytes taken from data()
+
+private:
+    volatile long nIn;
+    volatile long nOut;
+    byte buf[Size];
+};
+
+
+inline bool Ring::put(byte b)
+{
+    if (space() <= 0)
+        return false;
+    buf[nIn & (Size - 1)] = b;
+    ::InterlockedExchange(&nIn, nIn + 1);
+    return true;
+}
+
+
+inline int Ring::put(const byte* p, int n)
+{
+    int done = 0;
+    while (done < n)
+    {
+        int k = 0;
+        byte* d = span(k);
+        if (k == 0)
+            break;
+        k = min(k, n - done);
+        memcpy(d, p + done, k);
+        commit(k);
+        done += k;
+    }
+    return done;
+}
+
+
+inline byte* Ring::span(int& n)
+{
+    int i = nIn & (Size - 1);
+    n = min(space(), Size - i);
+    return &buf[i];
+}
+
+
+inline void Ring::commit(int n)
+{
+    ::InterlockedExchange(&nIn, nIn + n);
+}
+
+
+inline int Ring::get()
+{
+    if (count() <= 0)
+        return EMPTY;
+    int ch = buf[nOut & (Size - 1)];
+    ::InterlockedExchange(&nOut, nOut + 1);
+    return ch;
+}
+
+
+inline const byte* Ring::data(int& n)
+{
+    int i = nOut & (Size - 1);
+    n = min(count(), Size - i);
+    return &buf[i];
+}
+
+
+inline void Ring::consume(int n)
+{
+    ::InterlockedExchange(&nOut, nOut + n);
+}
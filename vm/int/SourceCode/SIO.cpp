@@ -36,9 +36,9 @@ int cI::inp(int addr)
             return data & 0xFF;
         }
     case 2:
-            return 0200 | (outIptEnabled ? 0100 : 0);
+            return (po->writeReady() ? 0200 : 0) | (outIptEnabled ? 0100 : 0);
     case 3:
-        return 0; // return outputData();
+        return po->winSize(); // reads as 0 on a real line
     }
     return 0;
 }
@@ -64,7 +64,7 @@ int cI::inpIpt()
 
 int cI::outIpt()
 {
-    return outIptEnabled;
+    return outIptEnabled && po->writeReady();
 }
 
 int cI::ipt()
@@ -81,12 +81,14 @@ int cI::addr()
 ///////////////////////////////////////////////////////////////////////////////
 // SIOs - collection of SIO
 
-SIOs::SIOs() : N(0), lastIpted(0)
+SIOs::SIOs() : rgsio(null), N(0), capacity(0), lastIpted(0)
 {
 }
 
 SIOs::~SIOs()
 {
+    if (rgsio != null)
+        GlobalFreePtr(rgsio);
 /*
     for (int i = 0; i < N; ++i)
     {
@@ -100,8 +102,21 @@ SIOs::~SIOs()
 
 void SIOs::addSIO(SIO *s)
 {
-    if (N < max_sio)
-        rgsio[N++] = s;
+    if (N == capacity)
+    {
+        int n = capacity == 0 ? 16 : capacity * 2;
+        SIO **p = (SIO **)GlobalAllocPtr(GPTR, n * sizeof(SIO *));
+        if (p == null)
+            return;
+        if (rgsio != null)
+        {
+            memcpy(p, rgsio, N * sizeof(SIO *));
+            GlobalFreePtr(rgsio);
+        }
+        rgsio = p;
+        capacity = n;
+    }
+    rgsio[N++] = s;
 }
 
 
@@ -32,6 +32,9 @@ struct SIOOutbound
     virtual void write(char *ptr, int bytes) = 0;
     virtual void writeChar(char ch) = 0;
     virtual void onKey(bool bDown, int nVirtKey, int lKeyData, int ch) = 0;
+    virtual bool writeReady() { return true; } // false while output is backed up
+    virtual int  writeSpace() { return 0x7FFFFFFF; } // bytes write() takes now
+    virtual int  winSize() { return 0; }        // cols | rows << 16, 0 if unknown
 };
 
 
@@ -54,9 +57,9 @@ public:
     SIO *find(int ioAddr);
 
 private:
-    enum { max_sio = 10 };
-    SIO *rgsio[max_sio];
+    SIO **rgsio;    // grows as lines are added
     int  N;
+    int  capacity;
     int  lastIpted;
 };
 
@@ -1,4 +1,5 @@
 #include "preCompiled.h"
+#define FD_SETSIZE 1024     // one select() serves the listener and all lines
 #include <winsock2.h>
 #include "SIO_TCP.h"
 #include "cO_tcp.h"
@@ -38,30 +39,54 @@ void SioTcp::out(int addr, int data) { i->out(addr, data); }
 int  SioTcp::busyRead() { return o->busyRead(); }
 void SioTcp::write(char *ptr, int bytes) { o->write(ptr, bytes); }
 void SioTcp::writeChar(char ch) { o->writeChar(ch); }
+bool SioTcp::writeReady() { return o->writeReady(); }
+int  SioTcp::writeSpace() { return o->writeSpace(); }
+int  SioTcp::winSize() { return o->winSize(); }
 
 // Ugly, need to do something about it:-
 int SioTcp::connect(dword so) { return ((cO_tcp*)o)->connect(so); }
 int SioTcp::connected() { return ((cO_tcp*)o)->connected(); }
+cO_tcp *SioTcp::tcp() { return (cO_tcp*)o; }
 
 
 ///////////////////////////////////////////////////////////////////////////////
 // SioTcps - server side
+//
+// One network thread for the listener and all lines: select() tells which
+// sockets are readable/writable, cO_tcp::pump() moves the data.
 
 
-SioTcps::SioTcps(word p) : port(p), N(0)
+SioTcps::SioTcps(word p) : rgtcp(null), N(0), capacity(0), port(p), thread(0)
 {
 }
 
 SioTcps::~SioTcps()
 {
-    TerminateThread((HANDLE)thread, 0);
+    if (thread != 0)
+        TerminateThread((HANDLE)thread, 0);
+    if (rgtcp != null)
+        GlobalFreePtr(rgtcp);
 }
 
 int SioTcps::addClient(SioTcp *p)
 {
-    if (N >= max_tcp)
+    if (N >= FD_SETSIZE - 1)
         return 0;
 
+    if (N == capacity)
+    {
+        int n = capacity == 0 ? 16 : capacity * 2;
+        SioTcp **q = (SioTcp **)GlobalAllocPtr(GPTR, n * sizeof(SioTcp *));
+        if (q == null)
+            return 0;
+        if (rgtcp != null)
+        {
+            memcpy(q, rgtcp, N * sizeof(SioTcp *));
+            GlobalFreePtr(rgtcp);
+        }
+        rgtcp = q;
+        capacity = n;
+    }
     rgtcp[N++] = p;
 
     return N;
@@ -80,7 +105,6 @@ void SioTcps::serve(dword so)
             "Thank you, Kronos Group.\r\n";
 
         send(so, msg, strlen(msg), 0);
-        Sleep(2000);
         closesocket(so);
     }
     else
@@ -120,11 +144,47 @@ dword SioTcps::Worker(void)
         return dw;
     }
 
-    do {
+    u_long nonBlocking = 1;
+    ioctlsocket(so, FIONBIO, &nonBlocking);
+
 trace("Kronos server is accepting connections...\n");
+    for (;;)
+        pump(so);
+}
+
+
+void SioTcps::pump(dword listener)
+{
+    fd_set rd;
+    fd_set wr;
+    FD_ZERO(&rd);
+    FD_ZERO(&wr);
+    FD_SET(listener, &rd);
+    for (int i = 0; i < N; ++i)
+    {
+        cO_tcp *t = rgtcp[i]->tcp();
+        if (!t->connected())
+            continue;
+        if (t->wantRead())
+            FD_SET(t->socket(), &rd);
+        if (t->wantWrite())
+            FD_SET(t->socket(), &wr);
+    }
+
+    timeval tv = { 0, tick * 1000 };
+    if (select(0, &rd, &wr, null, &tv) == SOCKET_ERROR)
+    {
+        dword dw = WSAGetLastError();
+        trace("select: %d [%08X]\n", dw, dw);
+        Sleep(tick);
+        return;
+    }
+
+    if (FD_ISSET(listener, &rd))
+    {
         SOCKADDR_IN sinClient;
         int sinLen = sizeof(sinClient);
-        dword soClient = accept(so, (SOCKADDR *)&sinClient, &sinLen);
+        dword soClient = accept(listener, (SOCKADDR *)&sinClient, &sinLen);
 
         if (soClient != INVALID_SOCKET)
         {
@@ -134,12 +194,15 @@ trace("Kronos server is accepting connections...\n");
 
             serve(soClient);
         }
-    } while (sin.sin_addr.S_un.S_addr == 0);
-// John - you never get here.
-// May be you need shutdown() same as in IGD480
-trace("Kronos server exiting...\n");
-    closesocket(so);
-    return 0;
+    }
+
+    // lines connected above are not in the sets yet, pump() just flushes
+    for (int i = 0; i < N; ++i)
+    {
+        cO_tcp *t = rgtcp[i]->tcp();
+        if (t->connected())
+            t->pump(FD_ISSET(t->socket(), &rd) != 0, FD_ISSET(t->socket(), &wr) != 0);
+    }
 }
 
 
@@ -2,6 +2,8 @@
 
 #include "SIO.h"
 
+class cO_tcp;
+
 class SioTcp : public SIO
 {
 public:
@@ -21,9 +23,13 @@ public:
     virtual void write(char *ptr, int bytes);
     virtual void writeChar(char ch);
     virtual void onKey(bool, int, int, int) {}
+    virtual bool writeReady();
+    virtual int  writeSpace();
+    virtual int  winSize();
 
     int connect(dword socket);
     int connected();
+    cO_tcp *tcp();
 
 private:
     SIOInbound *i;
@@ -43,13 +49,15 @@ public:
     dword Worker();
 
 private:
-    enum { max_tcp = 9 };
-    SioTcp *rgtcp[max_tcp];
+    enum { tick = 10 };     // ms, select() timeout, drives output coalescing
+    SioTcp **rgtcp;         // grows as lines are added, up to FD_SETSIZE - 1
     int N;
+    int capacity;
 
     word port;
     dword thread;
 
     SioTcp *find();
     void serve(dword so);
+    void pump(dword listener);
 };
\ No newline at end of file
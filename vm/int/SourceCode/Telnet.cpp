@@ -0,0 +1,177 @@
+#include "preCompiled.h"
+#include "Telnet.h"
+
+
+void Telnet::reset()
+{
+    iCtl  = nCtl = 0;
+    state = tsData;
+    verb  = 0;
+    nSb   = 0;
+    cr    = false;
+    size  = 0;
+
+    // offers are taken as accepted, a refusal turns them off again
+    us  = ours;
+    him = theirs;
+    put(WILL, ECHO);
+    put(WILL, SGA);
+    put(WILL, BINARY);
+    put(DO, SGA);
+    put(DO, BINARY);
+    put(DO, NAWS);
+}
+
+
+int Telnet::input(byte *p, int n)
+{
+    int k = 0;
+    for (int i = 0; i < n; i++)
+    {
+        byte b = p[i];
+        switch (state)
+        {
+            case tsData:
+                if (b == IAC)
+                    state = tsIac;
+                else if (cr && (b == 0 || b == '\n') && (him & 1 << BINARY) == 0)
+                    cr = false; // NVT end of line: CR NUL or CR LF -> CR
+                else
+                {
+                    cr = b == '\r';
+                    p[k++] = b;
+                }
+                break;
+            case tsIac:
+                state = tsData;
+                if (b == IAC)
+                {
+                    cr = false;
+                    p[k++] = b;
+                }
+                else if (b >= WILL && b <= DONT)
+                {
+                    verb  = b;
+                    state = tsOpt;
+                }
+                else if (b == SB)
+                {
+                    nSb   = 0;
+                    state = tsSb;
+                }
+                break;  // NOP, GA, AYT, ... ignored
+            case tsOpt:
+                negotiate(verb, b);
+                state = tsData;
+                break;
+            case tsSb:
+                if (b == IAC)
+                    state = tsSbIac;
+                else if (nSb < sizeof(sb))
+                    sb[nSb++] = b;
+                break;
+            case tsSbIac:
+                if (b == SE)
+                {
+                    subnegotiation();
+                    state = tsData;
+                }
+                else if (b == IAC)
+                {
+                    if (nSb < sizeof(sb))
+                        sb[nSb++] = b;
+                    state = tsSb;
+                }
+                else
+                    state = tsData;
+                break;
+        }
+    }
+    return k;
+}
+
+
+void Telnet::negotiate(int v, int opt)
+{
+    dword bit = opt < 32 ? 1 << opt : 0;
+    switch (v)
+    {
+        case DO:
+            if ((ours & bit) == 0)
+                put(WONT, (byte)opt);
+            else if ((us & bit) == 0)
+            {
+                us |= bit;
+                put(WILL, (byte)opt);
+            }
+            break;
+        case DONT:
+            if ((us & bit) != 0)
+            {
+                us &= ~bit;
+                put(WONT, (byte)opt);
+            }
+            break;
+        case WILL:
+            if ((theirs & bit) == 0)
+                put(DONT, (byte)opt);
+            else if ((him & bit) == 0)
+            {
+                him |= bit;
+                put(DO, (byte)opt);
+            }
+            break;
+        case WONT:
+            if ((him & bit) != 0)
+            {
+                him &= ~bit;
+                put(DONT, (byte)opt);
+            }
+            break;
+    }
+}
+
+
+void Telnet::subnegotiation()
+{
+    if (nSb >= 5 && sb[0] == NAWS)
+    {
+        dword cols = sb[1] << 8 | sb[2];
+        dword rows = sb[3] << 8 | sb[4];
+        size = cols | rows << 16;
+    }
+}
+
+
+bool Telnet::put(byte b)
+{
+    if (nCtl >= sizeof(ctl))
+        return false;
+    ctl[nCtl++] = b;
+    return true;
+}
+
+
+void Telnet::put(byte v, byte opt)
+{
+    if (nCtl + 3 > sizeof(ctl))
+        return;
+    put(IAC);
+    put(v);
+    put(opt);
+}
+
+
+const byte *Telnet::reply(int &n)
+{
+    n = nCtl - iCtl;
+    return &ctl[iCtl];
+}
+
+
+void Telnet::sent(int n)
+{
+    iCtl += n;
+    if (iCtl >= nCtl)
+        iCtl = nCtl = 0;
+}
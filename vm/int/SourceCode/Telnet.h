@@ -0,0 +1,59 @@
+#pragma once
+
+///////////////////////////////////////////////////////////////////////////////
+// Telnet:- option negotiation and IAC stripping for one connection.
+//
+// On connect we offer ECHO, SGA and BINARY and ask for SGA, BINARY and
+// NAWS, which puts ordinary clients into character at a time mode with
+// remote echo.  Everything the network thread has to send on its own
+// (negotiation replies, doubled IAC) is queued in ctl and goes out ahead
+// of the guest output.
+
+class Telnet
+{
+public:
+    Telnet() { reset(); }
+
+    void reset();                   // new connection, queues our offers
+    int  input(byte *p, int n);     // strips commands in place,
+                                    // returns number of data bytes left
+    bool put(byte b);               // queue control byte(s)
+    const byte *reply(int &n);      // queued control bytes
+    void sent(int n);               // n bytes of reply() sent
+
+    dword winSize() const { return size; } // cols | rows << 16, 0 if unknown
+
+    enum { IAC = 255 };
+
+private:
+    enum
+    {
+        DONT = 254, DO = 253, WONT = 252, WILL = 251,
+        SB   = 250, SE = 240,
+
+        BINARY = 0, ECHO = 1, SGA = 3, NAWS = 31,
+
+        ours   = 1 << ECHO | 1 << SGA | 1 << BINARY,   // we will
+        theirs = 1 << SGA | 1 << BINARY | 1 << NAWS    // we do
+    };
+
+    enum { tsData, tsIac, tsOpt, tsSb, tsSbIac };
+
+    void negotiate(int verb, int opt);
+    void subnegotiation();
+    void put(byte verb, byte opt);
+
+    byte  ctl[256];
+    int   iCtl;
+    int   nCtl;
+
+    int   state;
+    int   verb;
+    byte  sb[16];
+    int   nSb;
+    bool  cr;                       // last data byte was CR
+
+    dword us;                       // options enabled on our side
+    dword him;                      // options enabled on client side
+    volatile dword size;
+};
@@ -0,0 +1,91 @@
+//////////////////////////////////////////////////////////////////////////////
+// Tracer.cpp  binary execution trace
+
+#include "preCompiled.h"
+#include "Tracer.h"
+
+
+TRACER::TRACER() : on(false), ring(null), total(0), ticksPerMs(0), hRequest(null)
+{
+    szFile[0] = 0;
+}
+
+
+TRACER::~TRACER()
+{
+    on = false;
+    if (ring != null)
+        VirtualFree(ring, 0, MEM_RELEASE);
+    if (hRequest != null)
+        CloseHandle(hRequest);
+}
+
+
+bool TRACER::Open(const char* szFileName)
+{
+    if (on || strlen(szFileName) >= MAX_PATH)
+        return false;
+    ring = (TraceRec*)VirtualAlloc(null, Size * sizeof(TraceRec), MEM_COMMIT, PAGE_READWRITE);
+    if (ring == null)
+        return false;
+    strcpy(szFile, szFileName);
+
+    // calibrate time stamp counter against QueryPerformanceCounter:
+    LARGE_INTEGER f, c0, c1;
+    QueryPerformanceFrequency(&f);
+    QueryPerformanceCounter(&c0);
+    qword t0 = rdtsc();
+    Sleep(50);
+    QueryPerformanceCounter(&c1);
+    qword t1 = rdtsc();
+    // no 64 bit division without CRT, 50ms fits 32 bits on both clocks
+    int dQpc = (int)(c1.QuadPart - c0.QuadPart);
+    int dTsc = (int)((t1 - t0) >> Shift);
+    ticksPerMs = dQpc <= 0 ? 0 : MulDiv(dTsc, f.LowPart / 1000, dQpc);
+
+    char szEvent[64];
+    wsprintf(szEvent, "Kronos3vmTrace%d", GetCurrentProcessId());
+    hRequest = CreateEvent(null, FALSE, FALSE, szEvent);
+
+    on = true;
+    return true;
+}
+
+
+void TRACER::Poll()
+{
+    if (hRequest != null && WaitForSingleObject(hRequest, 0) == WAIT_OBJECT_0)
+        Dump();
+}
+
+
+void TRACER::Dump()
+{
+    if (!on)
+        return;
+    HANDLE h = CreateFile(szFile, GENERIC_WRITE, FILE_SHARE_READ, null,
+                          CREATE_ALWAYS, 0, null);
+    if (h == INVALID_HANDLE_VALUE)
+    {
+        trace("trace: cannot create %s\n", szFile);
+        return;
+    }
+    qword n = total;    // VM thread keeps running, a few of the oldest
+                        // records may be overwritten while we write
+    TraceHeader hdr;
+    memcpy(hdr.magic, "KRTRACE1", 8);
+    hdr.recSize    = sizeof(TraceRec);
+    hdr.count      = n < Size ? (dword)n : Size;
+    hdr.shift      = Shift;
+    hdr.ticksPerMs = ticksPerMs;
+    hdr.total      = n;
+
+    dword dw = 0;
+    WriteFile(h, &hdr, sizeof hdr, &dw, null);
+    dword first = (dword)((n - hdr.count) & (Size - 1));
+    dword tail  = min(hdr.count, Size - first);
+    WriteFile(h, &ring[first], tail * sizeof(TraceRec), &dw, null);
+    if (tail < hdr.count)
+        WriteFile(h, &ring[0], (hdr.count - tail) * sizeof(TraceRec), &dw, null);
+    CloseHandle(h);
+}
@@ -0,0 +1,94 @@
+//////////////////////////////////////////////////////////////////////////////
+// Tracer.h  binary execution trace (-trace:file)
+//
+// The last Size events are kept in memory, 16 bytes each, and written to
+// the trace file when the VM stops or when the named event
+// "Kronos3vmTrace<pid>" is signalled (checked by the timer thread).
+// vm/ktrace decodes the file.  When tracing is off every event costs one
+// test of a bool.
+//
+// File: TraceHeader, then count records oldest first.
+
+#pragma once
+
+#pragma pack(push, 1)
+
+struct TraceHeader
+{
+    char  magic[8];     // "KRTRACE1"
+    dword recSize;      // sizeof(TraceRec)
+    dword count;        // records that follow
+    dword shift;        // TraceRec.time = rdtsc >> shift
+    dword ticksPerMs;   // TraceRec.time units per millisecond
+    qword total;        // events recorded since start (>= count)
+};
+
+struct TraceRec
+{
+    dword time;
+    byte  kind;
+    byte  x;
+    word  y;
+    dword a;
+    dword b;
+};
+
+#pragma pack(pop)
+
+enum // TraceRec.kind           x       y       a       b
+{
+    trCall     = 1,         //  opcode  -       G       PC (entry)
+    trReturn   = 2,         //  -       -       G       PC
+    trTrap     = 3,         //  Ipt     -       P       PC
+    trTransfer = 4,         //  -       -       P from  P to
+    trDisk     = 5,         //  op      disk    sector  bytes
+    trSioIn    = 6,         //  byte    ioAddr  -       -
+    trSioOut   = 7          //  byte    ioAddr  -       -
+};
+
+
+#pragma warning(disable:4035) // no return value
+inline qword rdtsc()
+{
+    _asm rdtsc
+}
+#pragma warning(default:4035)
+
+
+class TRACER
+{
+public:
+    TRACER();
+    virtual ~TRACER();
+
+    bool Open(const char* szFileName);
+    void Dump();
+    void Poll();    // timer thread: dump if requested
+
+    inline void Event(int kind, int x, int y, dword a, dword b)
+    {
+        if (!on)
+            return;
+        TraceRec& r = ring[total & (Size - 1)];
+        r.time = (dword)(rdtsc() >> Shift);
+        r.kind = (byte)kind;
+        r.x    = (byte)x;
+        r.y    = (word)y;
+        r.a    = a;
+        r.b    = b;
+        total++;
+    }
+
+private:
+    enum
+    {
+        Size  = 1024 * K,   // records, power of 2
+        Shift = 8
+    };
+    bool      on;
+    TraceRec* ring;
+    qword     total;
+    dword     ticksPerMs;
+    HANDLE    hRequest;
+    char      szFile[MAX_PATH];
+};
@@ -1,7 +1,16 @@
 #include "preCompiled.h"
 #include "Disks.h"
+#include "HostFs.h"
 #include "Memory.h"
 #include "IGD480.h"
+#include "Idiv.h"
+#include "Tracer.h"
+#include "Journal.h"
+#include "Breaks.h"
+#include "Gdb.h"
+#include "Metrics.h"
+#include "Lockstep.h"
+#include "Disasm.h"
 #include "VM.h"
 
 // Rev. 0
@@ -22,11 +31,21 @@ ULONG __stdcall ThreadProc(void* pParam)
         WaitForSingleObject(pVM->hTimerThread, 20);
         if (pVM->bTimer)
         {
+            pVM->Metrics.timerLost++;
 //          static int nLost = 0;
 //          trace("Timer ipts total %d lost %d\n", nTotal, ++nLost);
         }
         pVM->bTimer = true;
 //      nTotal++;
+        pVM->Trace.Poll();
+        if (pVM->Gdb.Poll())
+            pVM->bDebug = true;
+        if (pVM->dwDeadline != 0 && int(GetTickCount() - pVM->dwDeadline) >= 0)
+        {
+            pVM->dwDeadline = 0;
+            pVM->exitCode = exitTimeout;
+            pVM->bDebug = true;
+        }
     }
     return 0;
 }
@@ -52,9 +71,20 @@ VM::VM(int nMemorySizeBytes, SioMouse* mouse, Console* con) :
     PCs = 0;
     Ipt = 0;
     code = (byte*)&mem[0];
+    icount = 0;
+    Breaks.Attach(&mem, &bDebug);
+    Lockstep.Attach(&mem);
     memset(&AStack, 0, sizeof AStack);
     bTimer = false;
     hTimerThread = NULL;
+    bStrictReals = false;
+    bHeadless = false;
+    dwDeadline = 0;
+    exitCode = 0;
+    hCapture = INVALID_HANDLE_VALUE;
+    szUntil[0] = 0;
+    nUntil = 0;
+    nMatched = 0;
 
     diskno = 0;
     
@@ -68,17 +98,37 @@ VM::VM(int nMemorySizeBytes, SioMouse* mouse, Console* con) :
 VM::~VM()
 {
     TerminateThread(hTimerThread, 0);
+    if (hCapture != INVALID_HANDLE_VALUE)
+        CloseHandle(hCapture);
 }
 
 
 byte* VM::GetCode(int f)
 {
+    if (f >= 0 && f < mem.GetSize())
+        return (byte*)mem.Words(f);
     if (f < 0 || f > mem.GetSize())
         Ipt = 3;
     return (byte*)&mem[f % mem.GetSize()];
 }
 
 
+// CX, CF and CM: procedure i of the module with globals at g. Calls
+// within one module keep the code pointer, it only depends on F.
+inline void VM::CallModule(int g, int i)
+{
+    G = g;
+    int f = mem[G];
+    if (f != F)
+    {
+        F = f;
+        code = GetCode(F);
+    }
+    PC = mem[F + i];
+    Trace.Event(trCall, IR, 0, G, PC);
+}
+
+
 inline int VM::Next()
 {
     return ((byte*)code)[PC++];
@@ -128,6 +178,14 @@ void VM::RestoreAStack()
         Ipt = 0x4C;
         i = AStackSize;
     }
+    if (i > 0 && sp + i <= AStackSize && mem.Valid(S - i, i) == i)
+    {
+        S -= i;
+        const int* p = mem.Words(S);
+        while (i-- > 0)
+            AStack[sp++] = p[i];
+        return;
+    }
     while (i-- > 0)
         Push(mem[--S]);
 }
@@ -135,6 +193,16 @@ void VM::RestoreAStack()
 
 void VM::SaveAStack()
 {
+    if (mem.Valid(S, sp + 1) == sp + 1)
+    {
+        int* p = mem.Words(S);
+        int n = sp;
+        while (sp != 0)
+            *p++ = AStack[--sp];
+        *p = n;
+        S += n + 1;
+        return;
+    }
     int i = S;
     while (sp != 0) mem[S++] = Pop();
     mem[S] = S - i;
@@ -153,13 +221,26 @@ void VM::Mark(int x, bool Extern)
         mem[S] = PC;
     S += 2; 
     L = i;
+    Lockstep.Boundary();
 }
 
 
+// A process descriptor (HW_descriptor in osKernel.d) is G, L, PC, M, S,
+// H; inside memory it is read and written in place, not through mem[].
 void VM::SaveRegisters()
 {
     mem[1] = P;
     SaveAStack();
+    if (mem.Valid(P, 5) == 5)
+    {
+        int* p = mem.Words(P);
+        p[0] = G;
+        p[1] = L;
+        p[2] = PC;
+        p[3] = M;
+        p[4] = S;
+        return;
+    }
     mem[P + 0] = G;
     mem[P + 1] = L;
     mem[P + 2] = PC;
@@ -171,6 +252,20 @@ void VM::SaveRegisters()
 void VM::RestoreRegisters()
 {
     mem[0] = P;
+    if (mem.Valid(P, 6) == 6)
+    {
+        const int* p = mem.Words(P);
+        G  = p[0];
+        F  = mem[G];
+        code = GetCode(F);
+        L  = p[1];
+        PC = p[2];
+        M  = p[3];
+        S  = p[4];
+        H  = p[5] - (AStackSize + 1);
+        RestoreAStack();
+        return;
+    }
     G = mem[P];
     F = mem[G];
     code = GetCode(F);
@@ -188,6 +283,8 @@ void VM::Transfer(int p_to, int p_from)
 {
 //  trace("Transfer from %08X to %08X\n", P, mem[p_to]);
     int i = mem[p_to];
+    Trace.Event(trTransfer, 0, 0, P, i);
+    Lockstep.Boundary();
     mem[p_from] = P;
     SaveRegisters();
     P = i; 
@@ -197,6 +294,8 @@ void VM::Transfer(int p_to, int p_from)
 
 void VM::Trap(int no)
 {
+    Trace.Event(trTrap, no, 0, P, PC);
+    Metrics.local.traps[no & 0xFF]++;
 //  trace("Trap %02.2X\n", no);
 //  xxx: (only for debuging emulator itself.
     #ifdef _DEBUG
@@ -237,6 +336,50 @@ void VM::Trap(int no)
 }
 
 
+// bit fields of 1..32 bits at any bit offset: only the words the field
+// touches are read or written, so a field in the last word of memory works
+static inline
+dword getBits(const dword* p, int ofs, int n)
+{
+    p += ofs >> 5;
+    int s = ofs & 0x1F;
+    dword v = p[0] >> s;
+    if (s + n > 32)
+        v |= p[1] << (32 - s);
+    return n == 32 ? v : v & ((1U << n) - 1);
+}
+
+
+static inline
+void putBits(dword* p, int ofs, int n, dword v)
+{
+    p += ofs >> 5;
+    int s = ofs & 0x1F;
+    dword m = n == 32 ? 0xFFFFFFFF : (1U << n) - 1;
+    v &= m;
+    p[0] = (p[0] & ~(m << s)) | (v << s);
+    if (s + n > 32)
+        p[1] = (p[1] & ~(m >> (32 - s))) | (v >> (32 - s));
+}
+
+
+// false and a fault at the first word outside memory a bit field touches
+bool VM::BitsValid(int adr, int ofs, int bits)
+{
+    if (bits <= 0)
+        return true;
+    int w = adr + (ofs >> 5);
+    int n = (((ofs & 0x1F) + bits - 1) >> 5) + 1;
+    int k = mem.Valid(w, n);
+    if (k < n)
+    {
+        mem.Fault(w + k);
+        return false;
+    }
+    return true;
+}
+
+
 void VM::bitBlt(dword* dst, int dofs, dword* src, int sofs, int bits)
 {
     assert(dofs >= 0 && dofs < 32);
@@ -257,8 +400,7 @@ void VM::bitBlt(dword* dst, int dofs, dword* src, int sofs, int bits)
         // copy first 32-ofs bits and advance
         int n = min(bits, 32 - dofs);
         dword mask = ((1U << n) - 1) << dofs;
-        *dst &= ~mask;
-        *dst |= *src & mask;
+        *dst = (*dst & ~mask) | (*src & mask);
         bits -= n;
         if (bits <= 0)
             return;
@@ -278,34 +420,25 @@ void VM::bitBlt(dword* dst, int dofs, dword* src, int sofs, int bits)
         dst += n;
         src += n;
         dword mask = (1U << m) - 1;
-        *dst &= ~mask;
-        *dst |= *src & mask;
+        *dst = (*dst & ~mask) | (*src & mask);
         return;
     }
 
-    int n = dofs - sofs;
-    assert(n != 0);
-    qword* pd = (qword*)dst;
-    qword* ps = (qword*)src;
+    // up to the next destination word, then whole destination words
+    // funneled from two source words
+    int n = min(bits, 32 - dofs);
+    putBits(dst, dofs, n, getBits(src, sofs, n));
+    dst += (dofs + n) >> 5;
+    sofs += n;
+    bits -= n;
     while (bits >= 32)
     {
-        qword mask = qword(0xFFFFFFFF) << dofs;
-        qword s = *ps;
-        s = n < 0 ? (s >> -n) : (s << n);
-        *pd &= ~mask;
-        *pd |= s & mask;
-        pd = (qword*)(++dst);
-        ps = (qword*)(++src);
+        *dst++ = getBits(src, sofs, 32);
+        sofs += 32;
         bits -= 32;
     }
     if (bits > 0)
-    {
-        qword mask = qword(((1U << bits) - 1)) << dofs;
-        qword s = *ps;
-        s = n < 0 ? (s >> -n) : (s << n);
-        *pd &= ~mask;
-        *pd |= s & mask;
-    }   
+        putBits(dst, 0, bits, getBits(src, sofs, bits));
 }
 
 
@@ -316,18 +449,10 @@ void VM::BitBlt(dword dst, int dofs, dword src, int sofs, int bits)
         Ipt = 0x4A; 
         return;
     }
-    dword  test = mem[dst] 
-                | mem[src]
-                | mem[dst + ((dofs + bits + 31) >> 5)]
-                | mem[src + ((sofs + bits + 31) >> 5)];
-    unused(test);
-    if (mem.OutOfRange())
-    {
-        Ipt = 3;
+    if (!BitsValid(dst, dofs, bits) || !BitsValid(src, sofs, bits))
         return;
-    }
-    dword* pdst = (dword*)(const byte*)&mem[dst + (dofs >> 5)];
-    dword* psrc = (dword*)(const byte*)&mem[src + (sofs >> 5)];
+    dword* pdst = (dword*)mem.Words(dst + (dofs >> 5));
+    dword* psrc = (dword*)mem.Words(src + (sofs >> 5));
     bitBlt(pdst, dofs & 0x1F, psrc, sofs & 0x1F, bits);
 }
 
@@ -350,24 +475,54 @@ void* memmove(void* _dst, void* _src, size_t count)
     return ret;
 }
 
-void VM::BitMove(int dst, int _dofs, int src, int _sofs, int bits)
+// MOVE and wmv copy upwards like the word loop of the microcode: with the
+// destination just above the source the first words repeat (fill does that)
+static
+void moveWords(int* t, const int* f, int n)
 {
-    dword  test = mem[dst] 
-                | mem[src]
-                | mem[dst + ((_dofs + bits + 31) >> 5)]
-                | mem[src + ((_sofs + bits + 31) >> 5)];
-    unused(test);
-    if (mem.OutOfRange())
+    if (t >= f + n || t + n <= f)
+        memcpy(t, f, n * 4);
+    else if (t < f)
     {
-        Ipt = 3;
-        return;
+        for (int k = 0; k < n; k++)
+            t[k] = f[k];
+    }
+    else if (t > f)
+    {
+        // [f, t+done) is the pattern already, copy from it in doubling steps
+        int done = 0;
+        while (done < n)
+        {
+            int len = (t - f) + done;
+            if (len > n - done)
+                len = n - done;
+            memcpy(t + done, f, len * 4);
+            done += len;
+        }
     }
+}
+
+// first word in which two strings differ or end, the words before are
+// equal and zero free
+static
+int diffWord(const dword* a, const dword* b, int n)
+{
+    int k = 0;
+    while (k < n && a[k] == b[k] && ((a[k] - 0x01010101) & ~a[k] & 0x80808080) == 0)
+        k++;
+    return k;
+}
+
+void VM::BitMove(int dst, int _dofs, int src, int _sofs, int bits)
+{
+    if (!BitsValid(dst, _dofs, bits) || !BitsValid(src, _sofs, bits))
+        return;
+    qlong qdst = (qlong(dst) << 5) + _dofs;   // bit addresses
+    qlong qsrc = (qlong(src) << 5) + _sofs;
     dst = dst + (_dofs >> 5);
     src = src + (_sofs >> 5);
     int dofs = _dofs & 0x1F;
     int sofs = _sofs & 0x1F;
-    qlong qdst = (qlong(dst) << 5) + _dofs;
-    qlong qsrc = (qlong(src) << 5) + _sofs;
 
     if (qdst <= qsrc || qdst >= (qsrc + bits)) // Non-Overlapping Buffers 
     {
@@ -380,18 +535,15 @@ void VM::BitMove(int dst, int _dofs, int src, int _sofs, int bits)
         return;
     }
 
-    dofs += bits - 1;
-    sofs += bits - 1;
-    dword* pdst = (dword*)(byte*)&mem[dst];
-    dword* psrc = (dword*)(byte*)&mem[src];
-    for (int k = 0; k < bits; k++)
+    // destination above the source: downwards a word at a time, each
+    // piece is read before anything above it is written
+    dword* pdst = (dword*)mem.Words(dst);
+    dword* psrc = (dword*)mem.Words(src);
+    while (bits > 0)
     {
-        if (psrc[sofs >> 5] & (1U << (sofs & 0x1F)))
-            pdst[dofs >> 5] |=  (1U << (dofs & 0x1F));
-        else
-            pdst[dofs >> 5] &= ~(1U << (dofs & 0x1F));
-        sofs--;
-        dofs--;
+        int n = min(bits, 32);
+        bits -= n;
+        putBits(pdst, dofs + bits, n, getBits(psrc, sofs + bits, n));
     }
 }
 
@@ -454,113 +606,37 @@ void VM::_gbblt(int mode, void* des, int dofs, void* sou, int sofs, int sz)
 }
 
 
+// fields of 1..32 bits, 32 is the whole (unaligned) word
 dword VM::BBU(int adr, int i, int sz)
 {
-    qword q = *(qword*)(const byte*)&mem[adr + (i >> 5)];
-    q = q >> (i & 0x1F);
-    dword d = (dword)q;
-    return d & ((1 << sz) - 1);
+    if (!BitsValid(adr, i, sz))
+        return 0;
+    return getBits((dword*)mem.Words(adr + (i >> 5)), i & 0x1F, sz);
 }
 
 
 void VM::BBP(int adr, int i, int sz, int j)
 {
-    dword wmask = (1U << sz) - 1;
-    qword  q = j & wmask;
-    qword mask = wmask;
-    q = q << (i & 0x1F);
-    mask = mask << (i & 0x1F);
-    qword* pq = (qword*)(const byte*)&mem[adr + (i >> 5)];
-    *pq = (*pq & ~mask) | q;
-/*
-{
-    char buf[33]; buf[32] = 0;
-    for (int k = 0; k < 32; k++)
-    {
-        buf[k] = ((1U << k) & j) ? '1' : '0';
-    }
-
-    dword* p = (dword*)pq;
-    char buf1[33]; buf1[32] = 0;
-    for (k = 0; k < 32; k++)
-    {
-        buf1[k] = ((1U << k) & *p) ? '1' : '0';
-    }
-
-    p++;
-    char buf2[33]; buf2[32] = 0;
-    for (k = 0; k < 32; k++)
-    {
-        buf2[k] = ((1U << k) & *p) ? '1' : '0';
-    }
-
-    trace("bbp(%08x, %d, %d, %s) = %s %s\n", adr, i, sz, buf, buf1, buf2);
-}
-*/
-}
-
-
-static
-int _idiv(qlong x, qlong y, int& rem)
-{
-    assert(y != 0);
-    qlong z  = 0; 
-    qlong bt = 1;
-    while (qabs(x) > qabs(y))
-    {
-        bt = bt << 1; 
-        y  = y << 1;
-    };
-    for (;;)
-    {
-        if ((x >= 0) == (y >= 0))
-        {
-            if (y < 0)
-            {
-                if (x <= y) { x = x - y;    z = z + bt; }
-            }
-            else
-            {
-                if (x >= y) { x = x - y;    z = z + bt; }
-            }
-        }
-        else
-        {
-            if (y < 0)
-            {
-                if (x > 0) { x = x + y;     z = z - bt; }
-            }
-            else
-            {
-                if (x < 0) { x = x + y;     z = z - bt; }
-            }
-        }
-        if (bt == 1)
-            break;
-        bt = bt >> 1;
-        if (y > 0)
-            y = (y & ~0x1) >> 1;
-        else
-            y = (y | 0x1) >> 1;
-    }
-    rem = int(x);
-    return int(z);
+    if (BitsValid(adr, i, sz))
+        putBits((dword*)mem.Words(adr + (i >> 5)), i & 0x1F, sz, j);
 }
 
 
 static
 int idiv(int x, int y)
 {
+    assert(y != 0);
     int rem = 0;
-    return _idiv(x, y, rem);
+    return kr_idiv(x, y, &rem);
 }
 
 
 static
 int imod(int x, int y)
 {
+    assert(y != 0);
     int rem = 0;
-    _idiv(x, y, rem);
+    kr_idiv(x, y, &rem);
     return rem;
 }
 
@@ -603,8 +679,13 @@ void VM::Run()
 {
     // let's don't eat 100% CPU:
     ::SetThreadPriority(::GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+    // reals: double precision, round to nearest, exceptions masked, not
+    // whatever the host left in the x87 control word
+    word cw = 0x027F;
+    _asm fldcw cw
     int a = 0; // used for debug monitor only
     bDebug = false;
+    exitCode = exitStopped;
     Ipt = 0;
     sp = 0;
     P = mem[1];
@@ -615,12 +696,20 @@ void VM::Run()
         {
             if (mem.OutOfRange())
                 Ipt = 3;
+            else if (Journal.replaying())
+            {
+                if (!Journal.NextIpt(icount, Ipt))
+                    ReplayStopped();
+            }
             else if (bTimer)
             {
                 if ((M & 0x2) != 0)
                 {
                     bTimer = false;
                     Ipt = 1; // timer ipt
+                    Journal.Event(icount, jTimer, 0, 0, 0, 0);
+                    Metrics.local.timerTaken++;
+                    Metrics.Checkpoint(icount);
                 }
             }
             else if ((M & 0x1) != 0)
@@ -635,6 +724,8 @@ void VM::Run()
                     if (s != NULL)
                         Ipt = s->ipt() + 1;
                 }
+                if (Ipt != 0)
+                    Journal.Event(icount, jIpt, Ipt, 0, 0, 0);
             }
         }
 
@@ -643,13 +734,20 @@ void VM::Run()
             Trap(Ipt);
             Ipt = 0;
         }
+        if (Lockstep.Due(icount))
+            LockstepStep();
         if (bDebug)
         {
-            if (!DebugMonitor(a))
+            if (Gdb.Attached())
+                bDebug = Gdb.Check(*this);
+            else if (bHeadless)
+                break;
+            else if (!DebugMonitor(a))
                 break;
         }
         PCs = PC;
         IR  = code[PC++];
+        icount++;
 
 //      Sleep(0);
 //      trace("PC = %08x IR = %02X\n", PC, IR);
@@ -765,6 +863,8 @@ void VM::Run()
             case 0x80: // I/O bus reset
                 break;
             case 0x81: // QUIT Stop processor 
+                if (bHeadless)
+                    exitCode = mem[G + 3];
                 bDebug = true;
                 break;
             case 0x82: // GETM Get Mask
@@ -790,11 +890,18 @@ void VM::Run()
             case 0x87:  // IDLE
             {
                 PC--;
-                Sleep(1);
+                if (!Journal.replaying())
+                {
+                    dword t = GetTickCount();
+                    Sleep(1);
+                    Metrics.local.idleMs += GetTickCount() - t;
+                    Metrics.Checkpoint(icount);
+                }
                 // no enabled interrupts => infinite idle
                 // dsu -p uses this to shutdown computer.
                 if (M == 0)
                 {
+                    exitCode = 0;
                     igd.shutdown();
                     return;
                 }
@@ -880,16 +987,20 @@ void VM::Run()
                 }
                 else
                 {
-                    for (;;)
+                    // compare what is in memory, the end of it is a fault
+                    // only if the arrays are equal up to there
+                    int n = mem.Valid(adr1, mem.Valid(adr, sz));
+                    const int* a = mem.Words(adr);
+                    const int* b = mem.Words(adr1);
+                    int k = 0;
+                    while (k < n - 1 && a[k] == b[k])
+                        k++;
+                    if (n < sz && (n == 0 || a[k] == b[k]))
                     {
-                        if (mem[adr] != mem[adr1] || sz ==1)
-                        {
-                            Push(adr1); Push(adr); break;
-                        }
-                        sz--;
-                        adr++;
-                        adr1++;
+                        k = n;
+                        mem.Fault(mem.Valid(adr, sz) == n ? adr + n : adr1 + n);
                     }
+                    Push(adr1 + k); Push(adr + k);
                 }
                 break;
             }
@@ -899,19 +1010,27 @@ void VM::Run()
                 int sz = Pop(); 
                 int f  = Pop(); 
                 int t  = Pop();
+                if (sz <= 0)
+                    break;
+                int n = mem.Valid(f, mem.Valid(t, sz));
                 if (t > f)
                 {
-                    t = t + sz - 1; 
-                    f = f + sz - 1;
-                    while (sz > 0)
+                    // downwards: the first word is the last one
+                    if (n < sz)
+                        mem.Fault(mem.Valid(f, sz) < sz ? f + sz - 1 : t + sz - 1);
+                    else
                     {
-                        mem[t] = mem[f]; 
-                        t--; f--; sz--;
+                        int* pt = mem.Words(t);
+                        const int* pf = mem.Words(f);
+                        while (n-- > 0)
+                            pt[n] = pf[n];
                     }
                 }
-                else if (sz > 0)
+                else
                 {
-                    memcpy((byte*)&mem[t], (byte*)&mem[f], sz*4);
+                    moveWords(mem.Words(t), mem.Words(f), n);
+                    if (n < sz)
+                        mem.Fault(mem.Valid(f, sz) == n ? f + n : t + n);
                 }
                 break;
             }
@@ -1215,15 +1334,13 @@ void VM::Run()
                 int i = Pop() & ~0xC0000000; // -{30,31}
                 if (sz < 0)
                     Ipt = 0x4A;
-                else
+                else if (sz > 0)
                 {
-                    while (sz > 0 && Ipt != 3)
-                    {
-                        mem[i++] = mem[j++];
-                        sz--;
-                        if (mem.OutOfRange())
-                            Ipt = 3;
-                    }
+                    // the words before the first one outside are moved
+                    int n = mem.Valid(j, mem.Valid(i, sz));
+                    moveWords(mem.Words(i), mem.Words(j), n);
+                    if (n < sz)
+                        mem.Fault(mem.Valid(j, sz) == n ? j + n : i + n);
                 }
                 break;
             }
@@ -1244,14 +1361,26 @@ void VM::Run()
             {
                 int i = Pop();
                 int j = Pop();
-                byte* pa = (byte*)&mem[i];
-                byte* pb = (byte*)&mem[j];
-                byte a = *pa++;
-                byte b = *pb++;
-                while (a == b && b != 0 && a != 0)
+                // a word at a time up to the word with the difference or 0
+                int na = mem.Valid(i, 0x7FFFFFFF);
+                int nb = mem.Valid(j, 0x7FFFFFFF);
+                int n = na < nb ? na : nb;
+                int k = diffWord((dword*)mem.Words(i), (dword*)mem.Words(j), n);
+                byte a = 0;
+                byte b = 0;
+                if (k == n)
+                    mem.Fault(na == n ? i + n : j + n);
+                else
                 {
+                    const byte* pa = (byte*)mem.Words(i + k);
+                    const byte* pb = (byte*)mem.Words(j + k);
                     a = *pa++;
                     b = *pb++;
+                    while (a == b && b != 0 && a != 0)
+                    {
+                        a = *pa++;
+                        b = *pb++;
+                    }
                 }
                 Push(b); Push(a); // bug in docs!!!
                 break;
@@ -1328,6 +1457,8 @@ void VM::Run()
                     F = mem[G]; 
                     code = GetCode(F);
                 }
+                Trace.Event(trReturn, 0, 0, G, PC);
+                Lockstep.Boundary();
                 break;
             }
 
@@ -1345,10 +1476,7 @@ void VM::Run()
                     int j = k & 0x3FFFFF; // *{0..21}
                     int i = Next(); 
                     Mark(G, true);
-                    G = mem[j];
-                    F = mem[G]; 
-                    code = GetCode(F);
-                    PC = mem[F+i];
+                    CallModule(mem[j], i);
                 }
                 break;
 
@@ -1357,7 +1485,11 @@ void VM::Run()
                 {
                     PC--; Ipt = 0x40;
                 }
-                else { int i = Next(); Mark(Pop(), false); PC = mem[F+i]; }
+                else
+                {
+                    int i = Next(); Mark(Pop(), false); PC = mem[F+i];
+                    Trace.Event(trCall, IR, 0, G, PC);
+                }
                 break;
 
             case 0xCE: // CF    Call Formal procedure
@@ -1372,10 +1504,7 @@ void VM::Run()
                     Mark(G, true);
                     int j = ((byte*)&i)[3];
                     i = i & 0xFFFFFF; // *{0..23};
-                    G = mem[i];
-                    F = mem[G];
-                    code = GetCode(F);
-                    PC = mem[F + j];
+                    CallModule(mem[i], j);
                 }
                 break;
 
@@ -1387,6 +1516,7 @@ void VM::Run()
                 else
                 {
                     int i = Next(); Mark(L, false); PC = mem[F + i];
+                    Trace.Event(trCall, IR, 0, G, PC);
                 };
                 break;
 
@@ -1403,6 +1533,7 @@ void VM::Run()
                 {
                     Mark(L, false); 
                     PC = mem[F + (IR & 0xF)];
+                    Trace.Event(trCall, IR, 0, G, PC);
                 }
                 break;
 
@@ -1504,9 +1635,12 @@ void VM::Run()
                     PC--; 
                     Ipt = 0x4A;
                 }
-                int i = Pop(); 
-                int adr = Pop();
-                Push(BBU(adr, i, sz));
+                else
+                {
+                    int i = Pop(); 
+                    int adr = Pop();
+                    Push(BBU(adr, i, sz));
+                }
                 break;
             }
 
@@ -1520,9 +1654,12 @@ void VM::Run()
                     PC--; 
                     Ipt = 0x4A;
                 }
-                int i = Pop(); 
-                int adr = Pop();
-                BBP(adr, i, sz, j);
+                else
+                {
+                    int i = Pop(); 
+                    int adr = Pop();
+                    BBP(adr, i, sz, j);
+                }
                 break;
             }
 
@@ -1599,9 +1736,7 @@ void VM::Run()
                     S--; 
                     int j = mem[S];
                     Mark(G,TRUE);
-                    G = j; 
-                    F = mem[G]; 
-                    PC = mem[F + i];
+                    CallModule(j, i);
                 }
                 else
                 {
@@ -1668,13 +1803,45 @@ void VM::Run()
                     case 0x1: printf("\n%08X\n", Pop()); break;
                     case 0x2: // microcode vers.
                               Push(2); break;
+                    case 0x3: // paravirtual extensions (VM only)
+                              Push(vmGlyphRun | vmHeapLists | vmConsoleRing |
+                                   (Host.Enabled() ? vmHostFiles : 0));
+                              break;
+                    case 0x4: // osKernel _alloc(VAR head, min, VAR a, VAR w)
+                    {
+                        int w = Pop();
+                        int a = Pop();
+                        int min = Pop();
+                        SliceAlloc(Pop(), min, a, w);
+                        break;
+                    }
+                    case 0x5: // osKernel _dealloc(VAR head, a, w)
+                    {
+                        int w = Pop();
+                        int a = Pop();
+                        SliceDealloc(Pop(), a, w);
+                        break;
+                    }
+                    case 0x6: // Heap try_ring: curr, w -> node or NIL
+                    {
+                        int w = Pop();
+                        Push(RingFind(Pop(), w));
+                        break;
+                    }
+                    case 0x7: // SIOqqBUS write: ocsr, ring -> bytes left
+                    {
+                        int ring = Pop();
+                        Push(ConsoleRing(Pop(), ring));
+                        break;
+                    }
                     default:
                         PC--; Ipt = 7;
                 }
                 break;
 
             case 0xFD: // NII Never Implemented Instruction
-                Ipt = 0x7;
+                if (!Gdb.Breakpoint(*this)) // or a breakpoint, see Breaks.h
+                    Ipt = 0x7;
                 break;
 
             case 0xFE: 
@@ -1715,7 +1882,20 @@ void VM::IO(int no)
             SIO *s = sios.find(ioAddr);
 
             if (s != NULL)
-                Push(s->inp(adr));
+            {
+                int data = 0;
+                if (!Journal.replaying())
+                    data = s->inp(adr);
+                else if (!Journal.Inp(icount, adr, data))
+                    ReplayStopped();
+                Journal.Event(icount, jInp, 0, adr, data, 0);
+                if ((adr & 3) == 1)
+                {
+                    Trace.Event(trSioIn, data, ioAddr, 0, 0);
+                    Metrics.local.sioIn[(ioAddr >> 2) & 0xFF]++;
+                }
+                Push(data);
+            }
             else
             {
                 trace("INP %03X ???\n", adr);
@@ -1734,7 +1914,19 @@ void VM::IO(int no)
             SIO *s = sios.find(ioAddr);
 
             if (s != NULL)
+            {
+                if ((adr & 3) == 3)
+                {
+                    Trace.Event(trSioOut, i, ioAddr, 0, 0);
+                    Metrics.local.sioOut[(ioAddr >> 2) & 0xFF]++;
+                    if (s == con)
+                    {
+                        char ch = char(i);
+                        ConsoleOutput(&ch, 1);
+                    }
+                }
                 s->out(adr, i);
+            }
             else
             {
                 trace("OUT %03X %08X ???\n", adr, i); 
@@ -1751,7 +1943,16 @@ void VM::IO(int no)
                 int sec = Pop();    // sector
                 int dsk = Pop();    // disk
                 int op  = Pop();    // operation
+                Trace.Event(trDisk, op, dsk, sec, len);
+                Breaks.Suspend();
                 Push(DiskOperation(op, dsk, sec, adr, len));
+                Breaks.Resume();
+                if ((dword)dsk < VmCounters::Disks)
+                {
+                    Metrics.local.diskOps[dsk]++;
+                    if (op == 4) Metrics.local.diskRead[dsk] += len;
+                    if (op == 5) Metrics.local.diskWritten[dsk] += len;
+                }
                 break;
         }
 
@@ -1761,10 +1962,21 @@ void VM::IO(int no)
                 break;
             }
 
-        case 0x4:
+        case 0x4: // 0x94 io4  -- host directory, see HostFs.h
             {
-                trace("io 0x94\n");
-                Ipt = 7;  PC -= 2;
+                if (!Host.Enabled())
+                {
+                    trace("io 0x94\n");
+                    Ipt = 7;  PC -= 2;
+                    break;
+                }
+                int len = Pop();    // bytes
+                int adr = Pop();    // address
+                int h   = Pop();    // handle or mode
+                int op  = Pop();    // operation
+                Breaks.Suspend();
+                Push(HostOperation(op, h, adr, len));
+                Breaks.Resume();
                 break;
             }
         default:
@@ -1823,8 +2035,268 @@ void VM::Quote(int op)
 
 
 
+// Free list walks of the Excelsior allocators (sys 4..6, vmHeapLists),
+// same lists in guest memory as the Modula-2 code they replace:
+//   osKernel slices  RECORD size: INTEGER; next: slice_ptr END
+//                    address ordered, NIL terminated, size in words
+//   Heap nodes       RECORD size: INTEGER; next, prev: list END
+//                    ring, busy blocks have bit 31 set in size
+// A list longer than memory is a loop: memory trap as the guest would
+// have looped forever.
+
+void VM::SliceAlloc(int head, int min, int a, int w)
+{
+    int size = mem[w];
+    int link = head;    // where the pointer to l lives
+    int l = mem[head];
+    for (int k = 0; l != Nil && mem[l] < size; k++)
+    {
+        if (k > mem.GetSize()) { Ipt = 3; return; }
+        link = l + 1;
+        l = mem[l + 1];
+    }
+    if (l == Nil)
+    {
+        mem[a] = Nil;
+        return;
+    }
+    if (mem[l] - size < min)
+    {
+        mem[w] = mem[l];
+        mem[link] = mem[l + 1];
+    }
+    else
+    {
+        int n = l + size;
+        mem[n + 1] = mem[l + 1];
+        mem[n] = mem[l] - size;
+        mem[link] = n;
+        mem[l] = size;
+    }
+    mem[a] = l;
+}
+
+
+void VM::SliceDealloc(int head, int a, int w)
+{
+    int n = a;
+    mem[n] = w;
+    int p = Nil;
+    int l = mem[head];
+    for (int k = 0; l != Nil && l < a; k++)
+    {
+        if (k > mem.GetSize()) { Ipt = 3; return; }
+        p = l;
+        l = mem[l + 1];
+    }
+    mem[n + 1] = l;
+    if (p == Nil)
+        mem[head] = n;
+    else if (p + mem[p] == n)
+    {
+        mem[p] = mem[p] + w;
+        n = p;
+    }
+    else
+        mem[p + 1] = n;
+    if (l != Nil && n + mem[n] == l)
+    {
+        mem[n + 1] = mem[l + 1];
+        mem[n] = mem[n] + mem[l];
+    }
+}
+
+
+int VM::RingFind(int curr, int w)
+{
+    int p = curr;
+    for (int k = 0; k <= mem.GetSize(); k++)
+    {
+        if (mem[p] >= w)
+            return p;
+        p = mem[p + 1];
+        if (p == curr)
+            return Nil;
+    }
+    Ipt = 3;
+    return Nil;
+}
+
+
+// Console ring (sys 7, vmConsoleRing) of SIOqqBUS.write, in guest memory:
+//   RECORD head, tail, size: INTEGER; buf: ARRAY [0..size-1] OF CHAR END
+// The guest fills buf at head, the doorbell sends from tail as much as the
+// line takes now and returns the bytes still in the ring. How much the
+// line takes is input from the host, journaled as a read of the ocsr.
+
+int VM::ConsoleRing(int adr, int ring)
+{
+    SIO *s = sios.find(adr & 0xFFC);
+    if (s == NULL)
+    {
+        Ipt = 3;
+        return 0;
+    }
+    int head = mem[ring];
+    int tail = mem[ring + 1];
+    int size = mem[ring + 2];
+    int words = (size + 3) / 4;
+    if (mem.OutOfRange() || size <= 0 || dword(head) >= dword(size) ||
+        dword(tail) >= dword(size) || mem.Valid(ring + 3, words) < words)
+    {
+        Ipt = 0x4F;
+        return 0;
+    }
+    int room = 0;
+    if (!Journal.replaying())
+        room = s->writeSpace();
+    else if (!Journal.Inp(icount, adr | 2, room))
+        ReplayStopped();
+    Journal.Event(icount, jInp, 0, adr | 2, room, 0);
+
+    char* buf = (char*)mem.Words(ring + 3);
+    int ioAddr = adr & 0xFFC;
+    while (tail != head && room > 0)
+    {
+        int n = (head > tail ? head : size) - tail;
+        if (n > room)
+            n = room;
+        for (int k = 0; k < n; k++)
+            Trace.Event(trSioOut, byte(buf[tail + k]), ioAddr, 0, 0);
+        Metrics.local.sioOut[(ioAddr >> 2) & 0xFF] += n;
+        if (s == con)
+            ConsoleOutput(buf + tail, n);
+        s->write(buf + tail, n);
+        room -= n;
+        tail = (tail + n) % size;
+    }
+    mem[ring + 1] = tail;
+    return (head - tail + size) % size;
+}
+
+
+// Strict reals are the Kronos format (fw/2.5/kr50ifp.mas), not IEEE:
+// exponent 0 is zero, 255 is a number, there are no infinities, NaNs or
+// denormals. Results are the exact value rounded half away from zero at
+// the last bit. Overflow and x/0 leave 0 and trap 42h, underflow of an
+// add or subtract gives 0, of a multiply, divide or FLOAT traps 43h,
+// TRUNC out of the integer range traps 41h. This is a model of the FPU,
+// not its microcode step by step: where the microcode truncates inside
+// its multiply or divide loop a last bit may differ from the hardware.
+// The arithmetic is done in double (x87 at 53 bits, see Run); + - * are
+// exact there and a quotient cannot land within 2^-53 of a tie, so the
+// rounding is the model's. vm/tests/fpstrict.boot checks it against an
+// integer implementation, see vm/fpboot.
+
+static
+double unpackReal(int x)
+{
+    double d = 0;
+    int e = (x >> 23) & 0xFF;
+    if (e != 0)
+    {
+        dword* w = (dword*)&d;
+        w[1] = (x & 0x80000000) | ((e - 127 + 1023) << 20) | ((x & 0x7FFFFF) >> 3);
+        w[0] = (x & 0x7) << 29;
+    }
+    return d;
+}
+
+
+static
+int packReal(double d, int& ipt, bool bUnderflow)
+{
+    const dword* w = (const dword*)&d;
+    int e = (w[1] >> 20) & 0x7FF;
+    if (e == 0)
+        return 0;
+    dword m = ((w[1] & 0xFFFFF) << 3) | (w[0] >> 29);
+    if ((w[0] >> 28) & 1)
+        m++;
+    if (m > 0x7FFFFF)
+    {
+        m = 0;
+        e++;
+    }
+    e = e - 1023 + 127;
+    if (e > 255)
+    {
+        ipt = 0x42;
+        return 0;
+    }
+    if (e <= 0)
+    {
+        if (bUnderflow)
+            ipt = 0x43;
+        return 0;
+    }
+    return (w[1] & 0x80000000) | (e << 23) | m;
+}
+
+
+void VM::FPUStrict()
+{
+    int x = 0;
+    int y = 0;
+    if (IR <= 0x9C)
+        y = Pop();
+    if (IR <= 0x9E)
+        x = Pop();
+    switch (IR)
+    {
+        case 0x98:  Push(packReal(unpackReal(x) + unpackReal(y), Ipt, false)); break;
+        case 0x99:  Push(packReal(unpackReal(x) - unpackReal(y), Ipt, false)); break;
+        case 0x9A:  Push(packReal(unpackReal(x) * unpackReal(y), Ipt, true));  break;
+        case 0x9B:
+            if (((y >> 23) & 0xFF) == 0)
+            {
+                Push(0);
+                Ipt = 0x42;
+            }
+            else
+                Push(packReal(unpackReal(x) / unpackReal(y), Ipt, true));
+            break;
+        case 0x9C:
+        {
+            double a = unpackReal(x);
+            double b = unpackReal(y);
+            if      (a > b) { Push(1); Push(0); }
+            else if (a < b) { Push(0); Push(1); }
+            else { Push(0); Push(0); }
+            break;
+        }
+        case 0x9D:  Push(x & 0x7FFFFFFF); break;
+        case 0x9E:  Push(x == 0 ? 0 : x ^ 0x80000000); break;
+        case 0x9F:
+            switch (Next())
+            {
+                case 0x0:   Push(packReal(double(Pop()), Ipt, true)); break;
+                case 0x1:
+                {
+                    double d = unpackReal(Pop());
+                    if (d >= 2147483648.0 || d <= -2147483648.0)
+                    {
+                        Push(0);
+                        Ipt = 0x41;
+                    }
+                    else
+                        Push(int(d));
+                    break;
+                }
+                default:    Ipt = 7; PC--; break;
+            }
+            break;
+    }
+}
+
+
 void VM::FPU()
 {
+    if (bStrictReals)
+    {
+        FPUStrict();
+        return;
+    }
     typedef struct { union {int i; float f;} u; } fi;
     fi x, y;
     x.u.f = 0;
@@ -1922,6 +2394,8 @@ void VM::ShowRegisters()
 //  i = mCode.CmdLen[code^[PC]];
     printf("P=%08X L=%08X S=%08X H=%08X G=%08X\n", P, L, S, H, G);
     printf("F=%08X PC=%08X IR=%02X (PC'=%08X)\nM=%08X", F, PC, IR, PCs, M);
+    if (mem.FaultAddress() != 0)
+        printf(" fault=%08X", mem.FaultAddress());
 //  FOR i = 1 TO i DO print('%02.2X ',code^[PC+i]) END;
     printf("\nA-Stack: ");
     if (sp == 0)
@@ -1986,12 +2460,127 @@ bool VM::DebugMonitor(int& a)
 }
 
 
+void VM::ReplayStopped()
+{
+    printf("\n%s\n", Journal.Why());
+    bDebug = true;
+}
+
+
+void VM::LockstepStep()
+{
+    StepRec now;
+    memset(&now, 0, sizeof now);
+    now.icount = icount;
+    now.PC = PC;
+    now.F  = F;
+    now.G  = G;
+    now.L  = L;
+    now.S  = S;
+    now.H  = H;
+    now.P  = P;
+    now.M  = M;
+    now.sp = sp;
+    for (int i = 0; i < sp; i++)
+        now.AStack[i] = AStack[i];
+    Breaks.Suspend();
+    bool same = Lockstep.Step(now);
+    Breaks.Resume(false);
+    if (!same)
+        LockstepDiverged();
+}
+
+
+void VM::LockstepDiverged()
+{
+    const StepRec& e = Lockstep.Expected();
+    const StepRec& p = Lockstep.Previous();
+    printf("\n%s\n", Lockstep.Why());
+    printf("reference:\nP=%08X L=%08X S=%08X H=%08X G=%08X\n", e.P, e.L, e.S, e.H, e.G);
+    printf("F=%08X PC=%08X M=%08X\nA-Stack: ", e.F, e.PC, e.M);
+    if (e.sp == 0)
+        printf("empty");
+    for (dword i = 0; i < e.sp && i < AStackSize; i++)
+        printf("%08X ", e.AStack[i]);
+    printf("\nthis run:\n");
+    ShowRegisters();
+    // the code since the last equal state if it is short and straight
+    int pc = PCs;
+    if (p.icount != 0 && int(p.F) == F && int(p.PC) <= PCs && PCs - int(p.PC) < 64)
+        pc = p.PC;
+    printf("\n");
+    char sz[64];
+    for (int n = 0; n < 24 && pc <= PCs; n++)
+    {
+        int len = Disasm(code, pc, sz);
+        printf("%s %s\n", pc == PCs ? "*" : " ", sz);
+        pc += len;
+    }
+    Disasm(code, PC, sz);
+    printf("> %s\n", sz);
+    bDebug = true;
+}
+
+
 void VM::setConsole(SIO *ps)
 {
     con = ps;
 }
 
 
+void VM::Headless(int nTimeoutSec)
+{
+    bHeadless = true;
+    if (nTimeoutSec > 0)
+        dwDeadline = (GetTickCount() + nTimeoutSec * 1000) | 1;
+}
+
+
+bool VM::Capture(const char* szFile)
+{
+    hCapture = CreateFile(szFile, GENERIC_WRITE, FILE_SHARE_READ, null,
+                          CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, null);
+    return hCapture != INVALID_HANDLE_VALUE;
+}
+
+
+void VM::Until(const char* szText)
+{
+    nUntil = min(int(strlen(szText)), int(sizeof szUntil) - 1);
+    memcpy(szUntil, szText, nUntil);
+    szUntil[nUntil] = 0;
+    nMatched = 0;
+}
+
+
+// guest console output: to the -capture: file up to and including the
+// -until: text; the text stops the run before the next instruction
+void VM::ConsoleOutput(const char* buf, int n)
+{
+    int k = n;
+    if (nUntil > 0)
+    {
+        for (k = 0; k < n && nMatched < nUntil; k++)
+        {
+            // longest prefix of szUntil the output ends with now
+            int m = nMatched + 1;
+            while (m > 0 && (szUntil[m - 1] != buf[k] ||
+                   memcmp(szUntil, szUntil + nMatched + 1 - m, m - 1) != 0))
+                m--;
+            nMatched = m;
+        }
+        if (nMatched == nUntil)
+        {
+            exitCode = 0;
+            bDebug = true;
+        }
+    }
+    dword dw = 0;
+    if (k > 0 && hCapture != INVALID_HANDLE_VALUE)
+        WriteFile(hCapture, buf, k, &dw, null);
+}
+
+
 void VM::printf(const char* fmt, ...)
 {
     char buf[1024];
@@ -2016,11 +2605,30 @@ int VM::DiskOperation(int op, int dsk, int sec, int adr, int len)
         case 2: return (int)Disks.Dismount(dsk);
         case 3: return Disks.GetSize4KB(dsk, (int*)&mem[adr]);
         case 4: return Disks.Read (dsk, sec, &mem[adr], len);
-        case 5: return Disks.Write(dsk, sec, &mem[adr], len);
+        case 5: 
+            {
+                Breaks.Hide(adr * 4, len);  // no planted NII on the disk
+                if (Journal.recording() || Journal.replaying())
+                {
+                    dword test = mem[adr]; test = mem[adr + (len - 1) / 4]; unused(test);
+                    dword sum = mem.OutOfRange() ? 0 : JOURNAL::Checksum(&mem[adr], len);
+                    if (Journal.recording())
+                        Journal.Event(icount, jWrite, dsk, 0, sec, sum);
+                    else if (!Journal.Write(icount, dsk, sec, sum))
+                        ReplayStopped();
+                }
+                bool ok = Disks.Write(dsk, sec, &mem[adr], len);
+                Breaks.Unhide(adr * 4, len);
+                return (int)ok;
+            }
         case 6: 
                 {
                     SYSTEMTIME st;
                     GetLocalTime(&st);
+                    if (Journal.replaying() && !Journal.Time(icount, st))
+                        ReplayStopped();
+                    Journal.Event(icount, jTime, st.wSecond, st.wYear,
+                                  st.wMonth << 8 | st.wDay, st.wHour << 8 | st.wMinute);
                     mem[adr++] = st.wYear;
                     mem[adr++] = st.wMonth;
                     mem[adr++] = st.wDay;
@@ -2040,6 +2648,41 @@ int VM::DiskOperation(int op, int dsk, int sec, int adr, int len)
 }
 
 
+int VM::HostOperation(int op, int h, int adr, int len)
+{
+    if (len < 0)
+    {
+        Ipt = 0x4A;
+        return 0;
+    }
+    if (len > 0 && op != hostClose && op != hostSize)
+    {
+        dword test = mem[adr];
+        test = mem[adr + (len - 1) / 4];
+        unused(test);
+        if (mem.OutOfRange())
+        {
+            Ipt = 3;
+            return 0;
+        }
+    }
+    byte* p = (byte*)&mem[adr];
+    switch (op)
+    {
+        case hostOpen:    return Host.Open(p, len, h);
+        case hostClose:   return Host.Close(h);
+        case hostRead:    return Host.Read(h, p, len);
+        case hostWrite:   return Host.Write(h, p, len);
+        case hostSize:    return Host.Size(h);
+        case hostOpenDir: return Host.OpenDir(p, len);
+        case hostReadDir: return Host.ReadDir(h, p, len);
+        default:
+                trace("invalid host operation: %d\n", op);
+                return -ERROR_INVALID_FUNCTION;
+    }
+}
+
+
 /////////////////////////////////////////////////////////////////
 // Bitmap graphics
 
@@ -2138,12 +2781,55 @@ void VM::BMG(int op)
                     circlef(ctx);
                     break;
                 }
+        case 10: { // display string (glyph run)
+                    int len = Pop();
+                    int pos = Pop();
+                    int high = Pop();
+                    int adr = Pop();
+                    Font* font = (Font*)(byte*)&mem[Pop()];
+                    int y = Pop();
+                    int x = Pop();
+                    Bitmap* bmp = (Bitmap*)(byte*)&mem[Pop()];
+                    int mode = Pop();
+                    if (pos < 0 || len < 0 || pos + len > high + 1)
+                        Ipt = 0x4A;
+                    else
+                        dstr(mode, bmp, x, y, font, adr, pos, len);
+                    break;
+                }
         default:
             PC--; Ipt = 7;
     }
 }
 
 
+void VM::glyph(int mode, dword* L, int wpl, int x32, const dword* F, int h,
+                dword wMask, dword inverse)
+{
+    // glyph rows are less than 32 bits wide, so each row lands in one qword
+    qword qMaskX32 = qword(wMask) << x32;
+    switch (mode)
+    {
+        case rep: 
+            for (; h > 0; h--, L += wpl, F++)
+                *(qword*)L = (*(qword*)L & ~qMaskX32) | (qword((*F ^ inverse) & wMask) << x32);
+            break;
+        case xor:
+            for (; h > 0; h--, L += wpl, F++)
+                *(qword*)L ^= qword((*F ^ inverse) & wMask) << x32;
+            break;
+        case bic:
+            for (; h > 0; h--, L += wpl, F++)
+                *(qword*)L &= ~(qword((*F ^ inverse) & wMask) << x32);
+            break;
+        case or:
+            for (; h > 0; h--, L += wpl, F++)
+                *(qword*)L |= qword((*F ^ inverse) & wMask) << x32;
+            break;
+    }
+}
+
+
 void VM::dch(int mode, Bitmap* bmp, int x, int y, Font* font, int ch)
 {
     ch = ch % 256;
@@ -2155,38 +2841,67 @@ void VM::dch(int mode, Bitmap* bmp, int x, int y, Font* font, int ch)
     dword* F = (dword*)(byte*)&mem[font->base + ch * h];
     dword* L = (dword*)(byte*)&mem[bmp->base + y * bmp->wpl + (x >> 5)];
 
-    int x32 = x % 32;
 //  trace(">dch(%d,%d ch=%d font+h*ch=0x%08X) w=%d, h=%d base=0x%08X\n", x, y, ch, F, w, h, font->base);
-    dword wMask = ((1U << w) - 1);
-    qword qMaskX32 = qword(wMask) << x32;
-    dword  qFInverse = mode & 4 ? dword(-1) : 0;
+    dword inverse = mode & 4 ? dword(-1) : 0;
+    glyph(mode & 3, L, bmp->wpl, x % 32, F, h, (1U << w) - 1, inverse);
+//  trace("<dch()\n");
+}
+
+
+// Draws len chars of string adr starting from byte pos left to right,
+// each one font->w pixels wide. Unlike dch() the glyph of char ch is 
+// taken from font->base + ch * font->rfe, so that font->h may be less
+// than the full glyph height (clipped rows). rfe == 0 paints the same
+// glyph for every char (BMG.m uses it for empty cells).
+// Everything is range checked once before the run is drawn.
+void VM::dstr(int mode, Bitmap* bmp, int x, int y, Font* font, int adr, int pos, int len)
+{
+    int w = font->w % 32;
+    int h = font->h % 64;
+    if (len == 0 || h == 0)
+        return;
+    if (x < 0 || y < 0)
+    {
+        Ipt = 0x4A;
+        return;
+    }
+    int stride = font->rfe;
+    dword test = mem[adr + (pos + len - 1) / 4];
+    const byte* str = (const byte*)&mem[adr] + pos;
+    if (mem.OutOfRange())
+    {
+        Ipt = 3;
+        return;
+    }
+    int lo = 255;
+    int hi = 0;
+    for (int k = 0; k < len; k++)
+    {
+        lo = min(lo, str[k]);
+        hi = max(hi, str[k]);
+    }
+    int row = bmp->base + y * bmp->wpl;
+    test = mem[font->base + lo * stride]
+         | mem[font->base + hi * stride + h - 1]
+         | mem[row + (x >> 5)]
+         | mem[row + (h - 1) * bmp->wpl + ((x + len * w) >> 5) + 1];
+    unused(test);
+    if (mem.OutOfRange())
+    {
+        Ipt = 3;
+        return;
+    }
+    dword inverse = mode & 4 ? dword(-1) : 0;
+    dword wMask = (1U << w) - 1;
     mode &= 3;
-    for (int i = 0; i < h; i++)
+    const dword* F = (const dword*)(byte*)&mem[font->base + lo * stride];
+    dword* L = (dword*)(byte*)&mem[row];
+    for (int i = 0; i < len; i++)
     {
-        qword* Q = (qword*)L;
-        qword  qL = *Q;
-        qword  qF = (*F ^ qFInverse) & wMask;
-        qF = qF << x32;
-        switch (mode)
-        {
-            case rep: 
-                *Q = (qL & ~qMaskX32) | qF;
-                break;
-            case xor:
-                *Q = qL ^ qF;
-                break;
-            case bic:
-                *Q = qL & ~qF;
-                break;
-            case or:
-                *Q = qL | qF;
-                break;
-        }
-        L += bmp->wpl;
-        F += 1;
+        const dword* G = F + (str[i] - lo) * stride;
+        glyph(mode, L + (x >> 5), bmp->wpl, x % 32, G, h, wMask, inverse);
+        x += w;
     }
-//  trace("\n");
-//  trace("<dch()\n");
 }
 
 
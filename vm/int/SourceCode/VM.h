@@ -7,6 +7,20 @@ enum {  AStackSize = 15,
         ExternalBit = 31
      };
 
+enum // paravirtual extensions reported to the guest by "sys 3"
+{
+    vmGlyphRun  = 0x0001,   // bmg 10 - display string
+    vmHostFiles = 0x0002,   // io4 - host directory (-host:dir given)
+    vmHeapLists = 0x0004,   // sys 4..6 - osKernel/Heap free list walks
+    vmConsoleRing = 0x0008  // sys 7 - SIOqqBUS output ring doorbell
+};
+
+enum // ExitCode() of a headless run other than quit, see Kronos3vm.cpp -boot:
+{
+    exitStopped = -1,       // breakpoint, watchpoint or end of replay
+    exitTimeout = -2        // -timeout:sec elapsed
+};
+
 class VM
 {
 public:
@@ -21,8 +35,29 @@ public:
     IGD480 igd;
     DISKS Disks;
     int DiskOperation(int op, int dsk, int sec, int adr, int len);
+    HOSTFS Host;
+    int HostOperation(int op, int h, int adr, int len);
 
     SIOs sios;
+    TRACER Trace;
+    JOURNAL Journal;
+    BREAKS Breaks;
+    GDBSTUB Gdb;
+    METRICS Metrics;
+    LOCKSTEP Lockstep;
+    qword Instructions() const { return icount; }
+
+    // headless: a stop ends Run() instead of entering the debug monitor;
+    // quit leaves G word 3 in ExitCode() (krest: STOP(n) is "sgw3 quit")
+    void Headless(int nTimeoutSec);
+    bool Capture(const char* szFile);   // guest console output to a file
+    void Until(const char* szText);     // stop with exit code 0 on output
+    int  ExitCode() const { return exitCode; }
+
+    // reals in the Kronos format and traps, rounded half away from zero
+    // (a model of the FPU, see VM.cpp), else host
+    // floats: faster, ties round to even, no traps, exponent 255 is inf
+    void StrictReals(bool b) { bStrictReals = b; }
 
     void setConsole(SIO *ps);
     int  busyRead();
@@ -43,12 +78,24 @@ private:
     int AStack[AStackSize];
     int sp;
     byte* code;
+    qword icount; // instructions executed, see Journal.h
 
     bool bTimer; // 20 msec interrupt source
+    bool bStrictReals;
+
+    bool   bHeadless;
+    dword  dwDeadline;  // GetTickCount() when headless run times out, 0 - never
+    int    exitCode;
+    HANDLE hCapture;
+    char   szUntil[64]; // console output that ends a headless run, see Until()
+    int    nUntil;
+    int    nMatched;    // length of the szUntil prefix the output ends with
+    void   ConsoleOutput(const char* buf, int n);
 
     SIO *con;
 
     byte*GetCode(int f);
+    void CallModule(int g, int i);
 
     inline void Push(int w);
     inline int  Pop();
@@ -67,8 +114,14 @@ private:
     void IO(int no);
     void BMG(int no);
     void FPU();
+    void FPUStrict();
     void Quote(int op);
+    void SliceAlloc(int head, int min, int a, int w);
+    void SliceDealloc(int head, int a, int w);
+    int  RingFind(int curr, int w);
+    int  ConsoleRing(int adr, int ring);
 
+    bool BitsValid(int adr, int ofs, int bits);
     void bitBlt(dword* dst, int dofs, dword* src, int sofs, int bits);
     void BitBlt(dword  dst, int dofs, dword  src, int sofs, int bits);
     void BitMove(int t, int t_o, int f, int f_o, int sz);
@@ -84,6 +137,8 @@ private:
     void vline(int mode, Bitmap* bmp, int x, int y, int len);
     void gbblt(int mode, int des, int dofs, int sou, int sofs, int nobits);
     void dch(int mode, Bitmap* bmp, int x, int y, Font* font, int ch);
+    void dstr(int mode, Bitmap* bmp, int x, int y, Font* font, int adr, int pos, int len);
+    void glyph(int mode, dword* L, int wpl, int x32, const dword* F, int h, dword wMask, dword inverse);
     int  clip(Clip* ctx, int w, int h);
     void line(int mode, Bitmap* bmp, int x, int y, int x1, int y1);
     void circle(int mode, Bitmap* bmp, Circle* ctx, int x, int y);
@@ -91,6 +146,9 @@ private:
     void trif(TriangleFilled*);
     void circlef(CircleFilled*);
 
+    void ReplayStopped();
+    void LockstepStep();
+    void LockstepDiverged();
     void ShowRegisters();
     bool DebugMonitor(int& a);
     void digits(int& a, char ch);
@@ -102,4 +160,6 @@ private:
 
 friend
     ULONG __stdcall ThreadProc(void* pParam);
+friend
+    class GDBSTUB;
 };
@@ -2,117 +2,207 @@
 #include <winsock2.h>
 #include "cO_tcp.h"
 
+///////////////////////////////////////////////////////////////////////////////
+// SIOOutbound:- telnet connection.
+//
+// VM thread and network thread only meet in the two rings, the network
+// thread (see SioTcps) moves data in bulk: recv() straight into free space
+// of inp, send() straight from queued data of out.  Output is coalesced,
+// it is sent when out is half full, when the VM stopped writing for idle ms
+// or when it has been held back for maxHold ms.  Backpressure both ways:
+// the socket is not read while inp is full and the SIO output status
+// reports "not ready" while out is full.  Telnet commands are stripped
+// from the input, IAC in the output is doubled.
+
 
-// SIOOutbound methods:
 int cO_tcp::busyRead()
 {
     if (!connected())
-        return EMPTY;
-
-    int ch = EMPTY;
-
-    if (chInput != 0)
     {
-        ch = chInput;
-        chInput = 0;
+        inp.consume(inp.count());   // leftovers of closed connection
+        return EMPTY;
     }
-    else if (!reading)
-        SetEvent(go);
+    return inp.get();
+}
 
-    return ch;
+
+void cO_tcp::write(char *ptr, int bytes)
+{
+    if (!connected())
+        return;
+    // guest driver polls writeReady() before each char, anything
+    // that does not fit here is lost the same way as on a real line
+    out.put((byte *)ptr, bytes);
 }
 
 
-dword __stdcall cO_tcp::tcpWorker(void *pv)
+void cO_tcp::writeChar(char ch)
 {
-    cO_tcp *p = (cO_tcp *)pv;
-    return p->tcpReader();
+    if (!connected())
+        return;
+    out.put((byte)ch);
 }
 
 
-dword cO_tcp::tcpReader()
+bool cO_tcp::writeReady()
 {
-    while (WaitForSingleObject(go, INFINITE) == WAIT_OBJECT_0)
-    {
-        char ch = 0;
+    return !connected() || out.space() > 0;
+}
 
-        reading = true;
 
-        int err = recv(so, &ch, 1, 0);
+int cO_tcp::writeSpace()
+{
+    return connected() ? out.space() : 0x7FFFFFFF;
+}
 
-        if (err == SOCKET_ERROR)
-        {
-            so = INVALID_SOCKET;
-        }
-        else
-            chInput = ch;
 
-        reading = false;
-    }
-    return 0;
+int cO_tcp::winSize()
+{
+    return connected() ? telnet.winSize() : 0;
 }
 
 
-void cO_tcp::write(char *ptr, int bytes)
+int cO_tcp::connect(dword s)
 {
-    if (!connected())
-        return;
+    if (so != INVALID_SOCKET)
+        return so == s;
 
-    int err = send(so, ptr, bytes, 0);
+    u_long nonBlocking = 1;
+    ioctlsocket(s, FIONBIO, &nonBlocking);
+    BOOL noDelay = TRUE;  // we do our own coalescing
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (char *)&noDelay, sizeof(noDelay));
 
-    if (err == SOCKET_ERROR)
-        so = INVALID_SOCKET;
+    telnet.reset();
+    so = s;
+    return true;
 }
 
-void cO_tcp::writeChar(char ch)
+
+int cO_tcp::connected()
 {
-    write(&ch, 1);
+    return so != INVALID_SOCKET;
 }
 
-int cO_tcp::connect(dword s)
-{
-    if (so == INVALID_SOCKET)
-        so = s;
 
-    return so == s;
+void cO_tcp::pump(bool readable, bool writable)
+{
+    if (!connected())
+        return;
+    if (readable && !pumpInput())
+        drop();
+    else if (!flushOutput(writable))
+        drop();
 }
 
-int cO_tcp::connected()
+
+bool cO_tcp::pumpInput()
 {
-    return so != INVALID_SOCKET;
+    int n = 0;
+    byte *p = inp.span(n);
+    if (n == 0)
+        return true;
+
+    int r = recv(so, (char *)p, n, 0);
+    if (r == 0)
+        return false;   // closed by peer
+    if (r == SOCKET_ERROR)
+        return WSAGetLastError() == WSAEWOULDBLOCK;
+
+    inp.commit(telnet.input(p, r));
+    return true;
 }
 
-cO_tcp::cO_tcp() : so(INVALID_SOCKET), thread(0), go(0), reading(0)
+
+bool cO_tcp::flushOutput(bool writable)
 {
-    dword id;
-    go = CreateEvent(NULL, FALSE, FALSE, NULL);
-    if (go == null)
+    int ctl = 0;
+    telnet.reply(ctl);
+    int pending = out.count();
+    if (pending == 0 && ctl == 0)
     {
-        delete this;
-        return;
+        lastCount = 0;
+        return true;
     }
 
-    thread = CreateThread(NULL, 4096, tcpWorker, (void *)this, 0, &id);
-    if (thread == null)
+    dword now = GetTickCount();
+    if (pending != lastCount)
     {
-        delete this;
-        return;
+        if (lastCount == 0)
+            since = now;
+        lastCount = pending;
+        changed = now;
     }
 
-    if (SetThreadPriority(thread, THREAD_PRIORITY_TIME_CRITICAL) == 0)
+    bool due = writable || ctl > 0 || pending >= Ring::Size / 2 ||
+               now - changed >= idle || now - since >= maxHold;
+    if (!due || (blocked && !writable))
+        return true;
+
+    blocked = false;
+    for (;;)
     {
-        delete this;
-        return;
+        int n = 0;
+        const byte *p = telnet.reply(n);
+        bool fromOut = n == 0;
+        if (fromOut)
+        {
+            if (out.count() == 0)
+                break;
+            p = out.data(n);
+            int k = 0;
+            while (k < n && p[k] != Telnet::IAC)
+                k++;
+            if (k == 0)
+            {
+                if (!telnet.put(Telnet::IAC) || !telnet.put(Telnet::IAC))
+                    return false; // cannot happen, reply() was empty
+                out.consume(1);
+                continue;
+            }
+            n = k;
+        }
+        int r = send(so, (const char *)p, n, 0);
+        if (r == SOCKET_ERROR)
+        {
+            if (WSAGetLastError() != WSAEWOULDBLOCK)
+                return false;
+            blocked = true;
+            break;
+        }
+        if (fromOut)
+            out.consume(r);
+        else
+            telnet.sent(r);
+        if (r < n)
+        {
+            blocked = true;
+            break;
+        }
     }
-}   
+    lastCount = out.count();
+    since = changed = now;
+    return true;
+}
+
+
+void cO_tcp::drop()
+{
+    closesocket(so);
+    so = INVALID_SOCKET;
+    out.consume(out.count());
+    blocked = false;
+    lastCount = 0;
+}
+
+
+cO_tcp::cO_tcp() : so(INVALID_SOCKET), blocked(false), lastCount(0),
+    changed(0), since(0)
+{
+}
 
 
 cO_tcp::~cO_tcp()
 {
-    if (thread != null)
-        TerminateThread(thread, 0);
-    if (thread != null)
-        CloseHandle(thread);
-    if (go != null)
-        CloseHandle(go);
+    if (so != INVALID_SOCKET)
+        closesocket(so);
 }
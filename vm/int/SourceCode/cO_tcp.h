@@ -1,6 +1,8 @@
 #pragma once
 
 #include "SIO.h"
+#include "Ring.h"
+#include "Telnet.h"
 
 class cO_tcp : public SIOOutbound
 {
@@ -10,23 +12,38 @@ public:
     virtual void write(char *ptr, int bytes);
     virtual void writeChar(char ch);
     virtual void onKey(bool, int, int, int) {}
+    virtual bool writeReady();
+    virtual int  writeSpace();
+    virtual int  winSize();
 
     int connect(dword socket);
     int connected();
 
+    // called by SioTcps network thread only:-
+    dword socket()    { return so; }
+    bool  wantRead()  { return inp.space() > 0; }
+    bool  wantWrite() { return blocked; }
+    void  pump(bool readable, bool writable);
+
     cO_tcp();
     virtual ~cO_tcp();
 private:
-    dword so;
-    char chInput;
-
-    // network reader thread:-
-    dword tcpReader();
-    HANDLE thread;
-    HANDLE go;
-    bool reading;
-
-    static dword __stdcall tcpWorker(void *pv);
+    enum
+    {
+        idle    = 10,   // ms without new output before it is sent
+        maxHold = 50    // ms, longest time output may be held back
+    };
+
+    volatile dword so;
+    Ring inp;           // network thread -> VM
+    Ring out;           // VM -> network thread
+    Telnet telnet;      // network thread only
+
+    bool  pumpInput();
+    bool  flushOutput(bool writable);
+    void  drop();
+    bool  blocked;      // last send() would block
+    int   lastCount;    // out.count() at previous pump
+    dword changed;      // tick count when out.count() last changed
+    dword since;        // tick count when out became non empty
 };
-
-
@@ -0,0 +1,222 @@
+﻿/*
+* KTRACE - decoder of Kronos3vm binary traces (c) KRONOS
+*
+* Purpose: timeline and statistics of a trace written by "Kronos3vm -trace:file"
+*          (see vm/int/SourceCode/Tracer.h for the format)
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#pragma pack(push, 1)
+
+typedef struct {
+	char     magic[8];
+	uint32_t recSize;
+	uint32_t count;
+	uint32_t shift;
+	uint32_t ticksPerMs;
+	uint64_t total;
+} TraceHeader;
+
+typedef struct {
+	uint32_t time;
+	uint8_t  kind;
+	uint8_t  x;
+	uint16_t y;
+	uint32_t a;
+	uint32_t b;
+} TraceRec;
+
+#pragma pack(pop)
+
+enum { trCall = 1, trReturn, trTrap, trTransfer, trDisk, trSioIn, trSioOut, trKinds };
+
+static const char* kinds[trKinds] = { "?", "call", "return", "trap", "transfer", "disk", "sio in", "sio out" };
+
+static TraceHeader hdr;
+static TraceRec*   recs;
+static double*     ms;	/* time of each record, ms from the first one */
+
+void usage(void)
+{
+	printf("ktrace - decode Kronos3vm trace\n"
+		"Usage:\n"
+		"\tktrace file        - statistics\n"
+		"\tktrace -t file     - timeline\n");
+	exit(1);
+}
+
+void load(const char* name)
+{
+	FILE* f = fopen(name, "rb");
+	if (f == NULL) {
+		printf("ERROR: cannot open \"%s\"\n", name);
+		exit(1);
+	}
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 || memcmp(hdr.magic, "KRTRACE1", 8) != 0 ||
+	    hdr.recSize != sizeof(TraceRec)) {
+		printf("ERROR: \"%s\" is not a Kronos3vm trace\n", name);
+		exit(1);
+	}
+	recs = malloc((size_t)hdr.count * sizeof(TraceRec) + 1);
+	ms = malloc((size_t)hdr.count * sizeof(double) + 1);
+	if (recs == NULL || ms == NULL) {
+		printf("ERROR: out of memory\n");
+		exit(1);
+	}
+	hdr.count = (uint32_t)fread(recs, sizeof(TraceRec), hdr.count, f);
+	fclose(f);
+
+	/* time stamps are 32 bit and wrap, events are in order */
+	uint64_t t = 0;
+	for (uint32_t i = 0; i < hdr.count; i++) {
+		if (i > 0) t += (uint32_t)(recs[i].time - recs[i - 1].time);
+		ms[i] = hdr.ticksPerMs ? (double)t / hdr.ticksPerMs : (double)i;
+	}
+}
+
+void timeline(void)
+{
+	for (uint32_t i = 0; i < hdr.count; i++) {
+		TraceRec* r = &recs[i];
+		printf("%12.4f  %-8s ", ms[i], r->kind < trKinds ? kinds[r->kind] : "?");
+		switch (r->kind) {
+		case trCall:     printf("%02X G=%06X PC=%04X\n", r->x, r->a, r->b); break;
+		case trReturn:   printf("   G=%06X PC=%04X\n", r->a, r->b); break;
+		case trTrap:     printf("%02X P=%06X PC=%04X\n", r->x, r->a, r->b); break;
+		case trTransfer: printf("   P=%06X -> P=%06X\n", r->a, r->b); break;
+		case trDisk:     printf("op=%d disk=%d sec=%u bytes=%u\n", r->x, r->y, r->a, r->b); break;
+		case trSioIn:
+		case trSioOut:   printf("%03X %02X\n", r->y, r->x); break;
+		default:         printf("%02X %04X %08X %08X\n", r->x, r->y, r->a, r->b); break;
+		}
+	}
+}
+
+/* procedures are (G, PC of entry) pairs, counted in an open hash */
+
+typedef struct { uint32_t g, pc, n; } Proc;
+
+static Proc*    procs;
+static uint32_t nprocs;
+static uint32_t hsize;
+
+void count_call(uint32_t g, uint32_t pc)
+{
+	uint32_t h = (g * 2654435761u ^ pc * 40503u) & (hsize - 1);
+	while (procs[h].n != 0 && (procs[h].g != g || procs[h].pc != pc))
+		h = (h + 1) & (hsize - 1);
+	if (procs[h].n++ == 0) {
+		procs[h].g = g;
+		procs[h].pc = pc;
+		nprocs++;
+	}
+}
+
+int by_count(const void* a, const void* b)
+{
+	uint32_t x = ((const Proc*)a)->n, y = ((const Proc*)b)->n;
+	return x < y ? 1 : x > y ? -1 : 0;
+}
+
+typedef struct { uint32_t ops[16]; uint64_t rd, wr; } Disk;
+typedef struct { uint64_t in, out; } Line;
+
+void statistics(void)
+{
+	static uint64_t nkind[256];
+	static uint64_t ntrap[256];
+	static uint64_t peak[256];	/* traps in the busiest 10ms window */
+	static Disk     disks[32];
+	static Line     lines[1024];
+
+	hsize = 1;
+	while (hsize < hdr.count * 2 + 2) hsize <<= 1;
+	procs = calloc(hsize, sizeof(Proc));
+	if (procs == NULL) {
+		printf("ERROR: out of memory\n");
+		exit(1);
+	}
+
+	uint32_t w0 = 0;	/* start of the sliding 10ms window */
+	static uint64_t inwin[256];
+	for (uint32_t i = 0; i < hdr.count; i++) {
+		TraceRec* r = &recs[i];
+		nkind[r->kind]++;
+		switch (r->kind) {
+		case trCall:
+			count_call(r->a, r->b);
+			break;
+		case trTrap:
+			ntrap[r->x]++;
+			inwin[r->x]++;
+			while (ms[i] - ms[w0] > 10.0) {
+				if (recs[w0].kind == trTrap) inwin[recs[w0].x]--;
+				w0++;
+			}
+			if (inwin[r->x] > peak[r->x]) peak[r->x] = inwin[r->x];
+			break;
+		case trDisk:
+			if (r->y < 32) {
+				disks[r->y].ops[r->x & 15]++;
+				if (r->x == 4) disks[r->y].rd += r->b;
+				if (r->x == 5) disks[r->y].wr += r->b;
+			}
+			break;
+		case trSioIn:  lines[r->y & 1023].in++;  break;
+		case trSioOut: lines[r->y & 1023].out++; break;
+		}
+	}
+
+	double span = hdr.count ? ms[hdr.count - 1] : 0;
+	printf("events: %llu recorded, last %u kept, %.3f ms\n",
+		(unsigned long long)hdr.total, hdr.count, span);
+	for (int k = 1; k < trKinds; k++)
+		if (nkind[k]) printf("  %-10s %10llu\n", kinds[k], (unsigned long long)nkind[k]);
+
+	printf("\ntraps:       count   peak/10ms\n");
+	for (int k = 0; k < 256; k++)
+		if (ntrap[k]) printf("  ipt %02X %10llu %10llu\n", k,
+			(unsigned long long)ntrap[k], (unsigned long long)peak[k]);
+
+	uint32_t n = 0;
+	for (uint32_t h = 0; h < hsize; h++)
+		if (procs[h].n) procs[n++] = procs[h];
+	qsort(procs, n, sizeof(Proc), by_count);
+	printf("\nmost called procedures (%u different):\n", nprocs);
+	for (uint32_t i = 0; i < n && i < 20; i++)
+		printf("  G=%06X PC=%04X %10u\n", procs[i].g, procs[i].pc, procs[i].n);
+
+	printf("\ndisks:\n");
+	for (int d = 0; d < 32; d++) {
+		uint32_t any = 0;
+		for (int op = 0; op < 16; op++) any |= disks[d].ops[op];
+		if (!any) continue;
+		printf("  disk%d read %u (%llu bytes) write %u (%llu bytes) other %u\n", d,
+			disks[d].ops[4], (unsigned long long)disks[d].rd,
+			disks[d].ops[5], (unsigned long long)disks[d].wr,
+			disks[d].ops[1] + disks[d].ops[2] + disks[d].ops[3] + disks[d].ops[6] +
+			disks[d].ops[8] + disks[d].ops[9]);
+	}
+
+	printf("\nserial lines:\n");
+	for (int l = 0; l < 1024; l++)
+		if (lines[l].in || lines[l].out)
+			printf("  %03X in %llu out %llu\n", l,
+				(unsigned long long)lines[l].in, (unsigned long long)lines[l].out);
+}
+
+int main(int argc, char** argv)
+{
+	int tl = 0;
+	int i = 1;
+	if (i < argc && strcmp(argv[i], "-t") == 0) { tl = 1; i++; }
+	if (i != argc - 1) usage();
+	load(argv[i]);
+	if (tl) timeline(); else statistics();
+	return 0;
+}
@@ -1,7 +1,7 @@
 ﻿/*
 * XDU - XD Utility (c) KRONOS 
 * 
-* Purpose: Basic access to Kronos vistual XD volume from Windows host
+* Purpose: Basic access to Kronos vistual XD volume from Windows and POSIX hosts
 * 
 */
 
@@ -12,6 +12,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include "xduTime.h"
+#include "xduCheck.h"
 
 void pindent(int level)   { while (level-- > 0) printf("  "); }
 
@@ -23,27 +24,101 @@ void pfilename(char* fn, int dir)
 	printf("%-16s", fname);
 }
 
-void copy_file(int ino, char* fname, char* path)
+/* xdu get: the directory walk creates directories and collects files,
+   then the files are extracted on a pool of threads */
+
+typedef struct {
+	int ino;
+	char path[248];
+} Job;
+
+static Job* jobs = null;
+static int jobs_no = 0;
+static int jobs_max = 0;
+static volatile long jobs_next = 0;
+
+typedef struct {
+	int files;
+	long long bytes;
+} Stats;
+
+static Stats stats[W_MAX_THREADS];
+
+void add_job(int ino, char* path)
+{
+	if (jobs_no == jobs_max) {
+		jobs_max = jobs_max == 0 ? 256 : jobs_max * 2;
+		jobs = realloc(jobs, jobs_max * sizeof(Job));
+		if (jobs == null) {
+			printf("not enough memory\n");
+			exit(1);
+		}
+	}
+	jobs[jobs_no].ino = ino;
+	strcpy(jobs[jobs_no].path, path);
+	jobs_no++;
+}
+
+/* streams the file at constant memory: up to CHUNK extents of the
+   mapped volume at a time, texts are converted block by block */
+#define CHUNK 64
+
+void copy_file(int ino, char* fullname, Stats* st)
 {
 	xFile file;
+	wExtent ext[CHUNK];
 	xfile_open(ino, &file);
 	assert((file.inode->mode & i_dir) == 0);
 
-	char fullname[248];
-	strncpy(fullname, path,248);
-	if (strlen(fullname) + strlen(fname) >= 248) {
-		printf("ERROR: too long filename \"%s/%s\"\n", path, fname);
-		exit(1);
+	wFile out = w_create(fullname);
+	int text = isText(fullname);
+	int n = 0;
+	int left = file.inode->eof;
+	int i;
+	for (i = 0; i < file.blocks_no; i++) {
+		char* block = xfile_block(&file, i);
+		int len = left < 4096 ? left : 4096;
+		left -= len;
+		if (text) {
+			char buf[4096];
+			memcpy(buf, block, len);
+			char* utf = toUTF8(buf, &len);
+			ext[0].data = utf;
+			ext[0].len = len;
+			w_write(out, fullname, ext, 1);
+			free(utf);
+		}
+		else if (n > 0 && ext[n - 1].data + ext[n - 1].len == block)
+			ext[n - 1].len += len; /* adjacent blocks make one extent */
+		else {
+			if (n == CHUNK) {
+				w_write(out, fullname, ext, n);
+				n = 0;
+			}
+			ext[n].data = block;
+			ext[n].len = len;
+			n++;
+		}
 	}
-	strcat(fullname, "/");
-	strcat(fullname, fname);
-	printf("%s\r", fullname);
-	char* content = xfile_read(&file);
-	w_copy_file(fullname, content, file.inode->eof, file.inode->cTime, file.inode->wTime);
+	if (n > 0) w_write(out, fullname, ext, n);
+	w_close(out, fullname, file.inode->cTime, file.inode->wTime);
+	st->files++;
+	st->bytes += file.inode->eof;
 	xfile_close(&file);
 	printf("%s -- DONE\n", fullname);
 }
 
+void copy_worker(void* arg, int no)
+{
+	(void)arg;
+	Stats* st = &stats[no];
+	for (;;) {
+		long i = w_atomic_inc(&jobs_next) - 1;
+		if (i >= jobs_no) break;
+		copy_file(jobs[i].ino, jobs[i].path, st);
+	}
+}
+
 void copy_dir(int ino, char* fname, char* path)
 {
 	xDir dir;
@@ -74,13 +149,20 @@ void copy_dir(int ino, char* fname, char* path)
 				copy_dir(dnode->inode, fname, fullname);
 			}
 			else if (dnode->kind & d_file) {
-				copy_file(dnode->inode, fname, fullname);
+				if (strlen(fullname) + strlen(fname) + 1 >= 248) {
+					printf("ERROR: too long filename \"%s/%s\"\n", fullname, fname);
+					exit(1);
+				}
+				char filename[248];
+				strcpy(filename, fullname);
+				strcat(filename, "/");
+				strcat(filename, fname);
+				add_job(dnode->inode, filename);
 			}
 		}
 		dnode++;
 	}
 	xdir_close(&dir);
-	printf("DIR %s -- DONE\n", fullname);
 }
 
 void listDir(int ino, int level)
@@ -146,9 +228,159 @@ void list()
 	listDir(0, 1);
 }
 
-void copy()
+void copy(int threads)
 {
+	unsigned start = w_msec();
 	copy_dir(0, "TMP", "");
+	if (threads > jobs_no) threads = jobs_no > 0 ? jobs_no : 1;
+	w_parallel(threads, copy_worker, null);
+
+	Stats total = { 0, 0 };
+	int i;
+	for (i = 0; i < threads; i++) {
+		total.files += stats[i].files;
+		total.bytes += stats[i].bytes;
+	}
+	unsigned ms = w_msec() - start;
+	printf("%d files, %lld bytes in %u ms on %d threads", total.files, total.bytes, ms, threads);
+	if (ms > 0)
+		printf(", %.1f MB/s", (double)total.bytes / 1048576.0 * 1000.0 / ms);
+	printf("\n");
+	free(jobs);
+}
+
+/* xdu put: host tree into the volume, metadata is flushed by unmount() */
+
+static int put_files = 0;
+static int put_dirs = 0;
+static long long put_bytes = 0;
+
+/* Excelsior name of a host file, 0 if there is none */
+int put_name(char* name, char* xname)
+{
+	int len = strlen(name);
+	char* koi = fromUTF8(name, &len);
+	int ok = len < 32 && xname_hash(koi) >= 0 && strcmp(koi, "..") != 0;
+	if (ok) strcpy(xname, koi);
+	free(koi);
+	return ok;
+}
+
+void put_file(char* path, char* xname, int dir, int mtime)
+{
+	int kind = 0;
+	int ino = xdir_find(dir, xname, &kind);
+	if (ino >= 0 && (kind & d_file) == 0) {
+		printf("SKIP %s: not a file in the volume\n", path);
+		return;
+	}
+	long long size = 0;
+	char* data = w_map_file(path, &size, 0);
+	if (size >= MAXFILE) {
+		printf("SKIP %s: %lld bytes, files are below %d bytes\n", path, size, MAXFILE);
+		w_unmap_file(data, size);
+		return;
+	}
+	int len = (int)size;
+	char* content = data;
+	char* converted = null;
+	if (isText(path)) {
+		converted = fromUTF8(data, &len);
+		content = converted;
+	}
+	if (ino < 0) {
+		ino = xfile_create(mtime);
+		xfile_write(ino, content, len, mtime);
+		xdir_link(dir, xname, ino, ktime_now());
+	}
+	else
+		xfile_write(ino, content, len, mtime);
+	if (converted) free(converted);
+	w_unmap_file(data, size);
+	put_files++;
+	put_bytes += len;
+	printf("%s -- DONE\n", path);
+}
+
+void put_dir(char* path, int dir)
+{
+	wEntry* list;
+	int n = w_list_dir(path, &list);
+	int i;
+	for (i = 0; i < n; i++) {
+		char fullname[248];
+		char xname[32];
+		if (strlen(path) + strlen(list[i].name) + 1 >= 248) {
+			printf("ERROR: too long filename \"%s/%s\"\n", path, list[i].name);
+			exit(1);
+		}
+		strcpy(fullname, path);
+		strcat(fullname, "/");
+		strcat(fullname, list[i].name);
+		if (!put_name(list[i].name, xname)) {
+			printf("SKIP %s: invalid Excelsior name\n", fullname);
+			continue;
+		}
+		if (list[i].dir) {
+			int kind = 0;
+			int sub = xdir_find(dir, xname, &kind);
+			if (sub >= 0 && (kind & d_dir) == 0) {
+				printf("SKIP %s: not a directory in the volume\n", fullname);
+				continue;
+			}
+			if (sub < 0) {
+				sub = xdir_make(dir, list[i].mtime);
+				xdir_link(dir, xname, sub, ktime_now());
+				put_dirs++;
+			}
+			printf("DIR %s\n", fullname);
+			put_dir(fullname, sub);
+		}
+		else
+			put_file(fullname, xname, dir, list[i].mtime);
+	}
+	free(list);
+}
+
+/* directory of the volume by path, missing ones are created */
+int put_target(char* xpath)
+{
+	int dir = 0;
+	char name[256];
+	while (*xpath != 0) {
+		while (*xpath == '/') xpath++;
+		int n = 0;
+		while (*xpath != 0 && *xpath != '/' && n < 255) name[n++] = *xpath++;
+		name[n] = 0;
+		if (n == 0) break;
+		char xname[32];
+		int kind = 0;
+		if (!put_name(name, xname)) {
+			printf("ERROR: invalid Excelsior name \"%s\"\n", name);
+			exit(1);
+		}
+		int sub = xdir_find(dir, xname, &kind);
+		if (sub >= 0 && (kind & d_dir) == 0) {
+			printf("ERROR: \"%s\" is not a directory\n", name);
+			exit(1);
+		}
+		if (sub < 0) {
+			sub = xdir_make(dir, ktime_now());
+			xdir_link(dir, xname, sub, ktime_now());
+			put_dirs++;
+		}
+		dir = sub;
+	}
+	return dir;
+}
+
+void put(char* path, char* xpath)
+{
+	unsigned start = w_msec();
+	put_dir(path, put_target(xpath));
+	unmount();
+	unsigned ms = w_msec() - start;
+	printf("%d files, %d new directories, %lld bytes in %u ms\n", put_files, put_dirs, put_bytes, ms);
 }
 
 void help()
@@ -157,9 +389,15 @@ void help()
 	printf("usage:\n");
 	printf("  xdu XDFile\n");
 	printf("     Prnts Kronos volume file tree, like as \"ls //*\"\n");
-	printf("  xdu XDFile get\n");
+	printf("  xdu XDFile get [-jN]\n");
 	printf("    Copy all files and directories from Kronos volume to ./TMP/ directory\n");
-	printf("    NOTE: *.d and *.m files are converted to UTF-8\n\n");
+	printf("    on N threads (default: one per CPU)\n");
+	printf("  xdu XDFile check [-jN]\n");
+	printf("    Check consistency of the volume on N threads, exit code 1 on errors\n");
+	printf("  xdu XDFile put HostDir [XDDir]\n");
+	printf("    Copy HostDir tree into XDDir (default /) of Kronos volume, replacing files\n");
+	printf("    with the same names. The volume must not be in use by the VM\n");
+	printf("    NOTE: *.d and *.m files are converted to UTF-8 and back\n\n");
 }
 
 int main(int argc, char** argv)
@@ -168,13 +406,26 @@ int main(int argc, char** argv)
 		help(); return 0;
 	}
 	init_console();
-	mount(argv[1]);
+	mount(argv[1], argc > 3 && strcmp(argv[2], "put") == 0);
 	if (argc > 2) {
-		if (strcmp(argv[2], "get") == 0) 
-			copy();
+		int threads = w_cpu_count();
+		if (argc > 3 && strncmp(argv[3], "-j", 2) == 0)
+			threads = atoi(argv[3] + 2);
+		if (threads < 1) threads = 1;
+		if (threads > W_MAX_THREADS) threads = W_MAX_THREADS;
+		if (strcmp(argv[2], "get") == 0)
+			copy(threads);
+		else if (strcmp(argv[2], "check") == 0) {
+			int errors = xdu_check(threads);
+			unmount();
+			return errors > 0 ? 1 : 0;
+		}
+		else if (strcmp(argv[2], "put") == 0 && argc > 3)
+			put(argv[3], argc > 4 ? argv[4] : "");
 		else {
 			help(); exit(0);
 		}
 	} else list();
+	unmount();
 	return 0;
 }
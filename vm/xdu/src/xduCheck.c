@@ -0,0 +1,246 @@
+/*
+* xdu check -- consistency of an XD volume, in the spirit of fschk.m
+*
+* 1. inode table scan on a pool of threads: inode fields, every block
+*    referenced by a busy inode is claimed once in a compact bitmap
+* 2. directory walk from the root: entries, "..", kinds, link counts
+* 3. busy maps against what was found: one linear pass over the maps
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "xduDisk.h"
+#include "xduWIO.h"
+#include "xduCheck.h"
+
+#define MAX_REPORTS 200
+
+static xVolInfo vol;
+static volatile long* owned = null;  // blocks claimed by inodes, 32 per word
+static int* refs = null;             // directory entries per inode
+static char* reached = null;         // inode found by the directory walk
+static volatile long errors = 0;
+static volatile long warnings = 0;
+static volatile long reports = 0;
+static volatile long chunks = 0;
+
+static void report(volatile long* counter, char* fmt, ...)
+{
+	w_atomic_inc(counter);
+	long n = w_atomic_inc(&reports);
+	if (n > MAX_REPORTS + 1) return;
+	if (n == MAX_REPORTS + 1) {
+		printf("... too many problems, the rest is only counted\n");
+		return;
+	}
+	va_list args;
+	va_start(args, fmt);
+	printf(counter == &errors ? "ERROR: " : "WARNING: ");
+	vprintf(fmt, args);
+	printf("\n");
+	va_end(args);
+}
+
+static int claim(int b, int ino, char* what)
+{
+	if (b <= vol.ino_hi || b >= vol.b_lim) {
+		report(&errors, "inode %d: %s block %d is out of the data area", ino, what, b);
+		return 0;
+	}
+	if (w_atomic_bts(&owned[b / 32], b % 32)) {
+		report(&errors, "inode %d: %s block %d is used twice", ino, what, b);
+		return 0;
+	}
+	return 1;
+}
+
+static void scan_inode(int ino)
+{
+	if (xdisk_inode_free(ino)) return;
+	iNode inode = get_inode(ino);
+	int dir = (inode->mode & i_dir) != 0;
+	if (inode->mode & ~i_all)
+		report(&errors, "inode %d: invalid mode %08X", ino, inode->mode);
+	if (inode->mode & i_esc) return; // device node, ref[] holds its name
+	if (inode->eof < 0 || inode->eof > MAXFILE) {
+		report(&errors, "inode %d: invalid eof %d", ino, inode->eof);
+		return;
+	}
+	if (dir && inode->eof % sizeof(dNodeRec) != 0)
+		report(&errors, "directory %d: eof %d is not a multiple of %d", ino, inode->eof, (int)sizeof(dNodeRec));
+	int n = (inode->eof + 4095) / 4096;
+	int x, j;
+	if (inode->mode & i_long) {
+		for (x = 0; x < 8; x++) {
+			int r = inode->ref[x];
+			if (r <= 0) {
+				if (dir && x * 1024 < n)
+					report(&errors, "directory %d: no index block %d", ino, x);
+				continue;
+			}
+			if (!claim(r, ino, "index")) continue;
+			int* rr = (int*)xdisk_block(r);
+			for (j = 0; j < 1024; j++) {
+				if (rr[j] > 0)
+					claim(rr[j], ino, "data");
+				else if (dir && x * 1024 + j < n)
+					report(&errors, "directory %d: hole at block %d", ino, x * 1024 + j);
+			}
+		}
+	}
+	else {
+		if (n > 8) {
+			report(&errors, "inode %d: eof %d does not fit a short file", ino, inode->eof);
+			n = 8;
+		}
+		for (x = 0; x < 8; x++) {
+			if (inode->ref[x] > 0)
+				claim(inode->ref[x], ino, "data");
+			else if (dir && x < n)
+				report(&errors, "directory %d: hole at block %d", ino, x);
+		}
+	}
+}
+
+/* one inode block per job */
+static void scan_worker(void* arg, int no)
+{
+	(void)arg; (void)no;
+	for (;;) {
+		long c = w_atomic_inc(&chunks) - 1;
+		int ino = (int)c * 64;
+		if (ino >= vol.i_no) break;
+		int last = ino + 64 < vol.i_no ? ino + 64 : vol.i_no;
+		for (; ino < last; ino++) scan_inode(ino);
+	}
+}
+
+static void walk(int dir, int parent, char* path)
+{
+	if (reached[dir]) {
+		report(&errors, "%s: directory %d is linked twice", path, dir);
+		return;
+	}
+	reached[dir] = 1;
+	iNode inode = get_inode(dir);
+	int count = inode->eof / sizeof(dNodeRec);
+	int has_parent = 0;
+	int i;
+	for (i = 0; i < count; i++) {
+		int b = xfile_bmap(inode, i / 64);
+		if (b <= vol.ino_hi || b >= vol.b_lim) { // reported by the scan
+			i += 63;
+			continue;
+		}
+		dNode dnode = (dNode)xdisk_block(b) + i % 64;
+		int kind = dnode->kind;
+		if ((kind & d_del) != 0 || (kind & d_entry) == 0) continue;
+		if (memchr(dnode->name, 0, sizeof(dnode->name)) == null) {
+			report(&errors, "%s: entry %d has no name", path, i);
+			continue;
+		}
+		int ino = dnode->inode;
+		if (ino < 0 || ino >= vol.i_no) {
+			report(&errors, "%s/%s: invalid inode %d", path, dnode->name, ino);
+			continue;
+		}
+		if (strcmp(dnode->name, "..") == 0) {
+			if (ino != parent)
+				report(&errors, "%s: \"..\" is %d, not %d", path, ino, parent);
+			has_parent = 1;
+			continue;
+		}
+		if (xname_hash(dnode->name) < 0)
+			report(&warnings, "%s/%s: invalid name", path, dnode->name);
+		if (xdisk_inode_free(ino)) {
+			report(&errors, "%s/%s: inode %d is free", path, dnode->name, ino);
+			continue;
+		}
+		iNode file = get_inode(ino);
+		if (((kind & d_dir) != 0) != ((file->mode & i_dir) != 0) ||
+			((kind & d_esc) != 0) != ((file->mode & i_esc) != 0)) {
+			report(&errors, "%s/%s: entry kind %02X for inode %d mode %02X", path, dnode->name, kind, ino, file->mode);
+			continue;
+		}
+		refs[ino]++;
+		if (kind & d_dir) {
+			char sub[512];
+			if (strlen(path) + strlen(dnode->name) + 2 < sizeof(sub)) {
+				strcpy(sub, path);
+				strcat(sub, "/");
+				strcat(sub, dnode->name);
+			}
+			else
+				strcpy(sub, "...");
+			walk(ino, dir, sub);
+		}
+		else
+			reached[ino] = 1;
+	}
+	if (!has_parent)
+		report(&errors, "%s: no \"..\" entry", path);
+}
+
+int xdu_check(int threads)
+{
+	unsigned start = w_msec();
+	xdisk_info(&vol);
+	errors = warnings = reports = chunks = 0;
+	owned = calloc((vol.b_lim + 31) / 32, sizeof(long));
+	refs = calloc(vol.i_no, sizeof(int));
+	reached = calloc(vol.i_no, 1);
+	if (owned == null || refs == null || reached == null) {
+		printf("not enough memory\n");
+		exit(1);
+	}
+	if (vol.b_lim < vol.b_no)
+		report(&errors, "volume has %d blocks, the file only %d", vol.b_no, vol.b_lim);
+
+	if (threads > (vol.i_no + 63) / 64) threads = (vol.i_no + 63) / 64;
+	if (threads < 1) threads = 1;
+	w_parallel(threads, scan_worker, null);
+
+	if (xdisk_inode_free(0) || (get_inode(0)->mode & i_dir) == 0)
+		report(&errors, "root inode 0 is not a busy directory");
+	else
+		walk(0, 0, "");
+
+	int ino;
+	int files = 0;
+	for (ino = 0; ino < vol.i_no; ino++) {
+		if (xdisk_inode_free(ino)) continue;
+		files++;
+		if (!reached[ino])
+			report(&warnings, "inode %d is busy but not in any directory", ino);
+		else if (ino != 0 && get_inode(ino)->links != refs[ino])
+			report(&errors, "inode %d: links %d, directory entries %d", ino, get_inode(ino)->links, refs[ino]);
+	}
+
+	int b;
+	int used = 0;
+	int leaked = 0;
+	for (b = 0; b < vol.b_lim; b++) {
+		int marked = xdisk_block_free(b);
+		if (b <= vol.ino_hi) {
+			if (marked) report(&errors, "system block %d is marked free", b);
+			continue;
+		}
+		int own = (owned[b / 32] >> (b % 32)) & 1;
+		if (own) used++;
+		if (own && marked)
+			report(&errors, "block %d is in use but marked free", b);
+		else if (!own && !marked)
+			leaked++;
+	}
+	if (leaked > 0)
+		report(&warnings, "%d blocks are marked busy but not used by any file", leaked);
+
+	printf("%d inodes, %d blocks in use, %ld errors, %ld warnings in %u ms on %d threads\n",
+		files, used, errors, warnings, w_msec() - start, threads);
+	free((void*)owned);
+	free(refs);
+	free(reached);
+	return (int)errors;
+}
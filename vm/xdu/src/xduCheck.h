@@ -0,0 +1,7 @@
+#ifndef XDUCHECK_INCLUDED
+#define XDUCHECK_INCLUDED
+
+/* consistency check of the mounted volume, returns number of errors */
+int xdu_check(int threads);
+
+#endif
@@ -1,8 +1,8 @@
 /*
 * disk layout:
 * block 0 -- cold booter
-* block 1 -- superblock (label, inodes busy map)
-* blocks 2..X - inodes table
+* block 1 -- superblock (label, blocks and inodes busy maps)
+* blocks ino_lo..ino_hi - inodes table, 64 inodes per block
 * . . . 
 * . . .
 * . . .
@@ -15,25 +15,43 @@
 #include "string.h"
 #include "assert.h"
 #include "xduTime.h"
+#include "xduWIO.h"
 
 typedef int  WBLOCK[1024];
 typedef char CBLOCK[4096];
 typedef iNodeRec IBLOCK[4096 / 64];
 
+#define LABEL 16        // words of the label in front of the busy maps
+#define CXE 0x00455843  // "CXE" superblock magic
+
 typedef struct {
-	char *data;
-	WBLOCK* iblocks;
-	CBLOCK* cblocks;
-	iNodeRec* inodes;
+	char *data;     // mapping of the volume file, read only unless mounted for put
+	long long size;
+	int writable;
+	char** dirty;   // put: private copies of changed metadata blocks, see unmount()
+	int dirty_no;
+	int* freed;     // put: blocks of replaced files, marked free by unmount()
+	int freed_no;
+	int freed_max;
 
 	char label[8];
 	int i_no;
 	int b_no;
 	int c_time;
+	int ino_lo;     // inode table blocks, as inoL/inoH in osFileSystem
+	int ino_hi;
+	int b_lim;      // blocks that exist both in the label and in the file
+	int sb_b;       // no free blocks in the busy map words below
 } xDiskRec;
 
 static xDiskRec *disk = NULL;
-static char iobuf[8192];
+
+char* xdisk_block(int b)
+{
+	assert((b >= 0 && b < disk->b_lim));
+	if (disk->dirty != null && disk->dirty[b] != null) return disk->dirty[b];
+	return disk->data + (long long)b * 4096;
+}
 
 void unpackSuper(xDiskRec* disk) {
 	char* super = disk->data + 4096;
@@ -42,83 +60,221 @@ void unpackSuper(xDiskRec* disk) {
 	disk->i_no = label[4];
 	disk->b_no = label[5];
 	disk->c_time = label[7];
-	disk->inodes = (iNode)&disk->data[4096 + 4096];
-	disk->iblocks = (WBLOCK*)disk->data;
-	disk->cblocks = (CBLOCK*)disk->data;
+	int words = (disk->i_no + 31) / 32 + (disk->b_no + 31) / 32 + LABEL;
+	disk->ino_lo = 1 + (words + 1023) / 1024;
+	disk->ino_hi = disk->ino_lo + (disk->i_no + 63) / 64 - 1;
+	disk->b_lim = disk->size / 4096 < disk->b_no ? (int)(disk->size / 4096) : disk->b_no;
+	disk->sb_b = 0;
+	if (label[6] != CXE || disk->i_no <= 0 || disk->b_no <= 0 || disk->ino_hi >= disk->b_lim) {
+		printf("not an Excelsior volume: label %08X inodes %d blocks %d\n", label[6], disk->i_no, disk->b_no);
+		exit(1);
+	}
 }
 
-void mount(char* fname) {
+void mount(char* fname, int writable) {
 	static xDiskRec _disk;
 	if (disk != null) {
 		printf("disk \"%s\" already mounted\n", disk->label);
 		exit(1);
 	}
-	FILE *file = fopen(fname, "rb");
-	if (!file) {
-		perror("file open");
-		exit(1);
-	}
-	if (fseek(file, 0, SEEK_END) != 0) {
-		perror("SEEK ERROR");
-		exit(1);
-	}
-	long fsize = ftell(file);
-	if (fsize < 0) {
-		perror("FTELL ERROR");
-		exit(1);
-	}
-	if (fsize % 4096 != 0) {
-		printf("%s: invalid file size %d", fname, fsize);
-		exit(1);
-	}
-	_disk.data = (char *)malloc(fsize);
-	if (_disk.data == NULL) {
-		printf("not enough memory for %d bytes\n", fsize);
-		exit(1);
-	}
-	rewind(file);
-	size_t read = fread(_disk.data, 1, fsize, file);
-	if (read != fsize) {
-		perror("FILE READ ERROR");
+	long long fsize = 0;
+	_disk.data = w_map_file(fname, &fsize, writable);
+	if (fsize % 4096 != 0 || fsize < 3 * 4096) {
+		printf("%s: invalid file size %lld\n", fname, fsize);
 		exit(1);
 	}
+	_disk.size = fsize;
+	_disk.writable = writable;
+	_disk.dirty = null;
+	_disk.dirty_no = 0;
+	_disk.freed = null;
+	_disk.freed_no = 0;
+	_disk.freed_max = 0;
 
 	unpackSuper(&_disk);
+	if (writable) {
+		_disk.dirty = calloc(_disk.b_lim, sizeof(char*));
+		if (_disk.dirty == null) {
+			printf("not enough memory\n");
+			exit(1);
+		}
+	}
 	disk = &_disk;
 	printf("XD volume \"%s\":  label \"%s\" blocks %d created: ", fname, disk->label, disk->b_no);
 	pKronosTime(disk->c_time);
 	printf("\n");
 }
 
+static void b_free(int k);
+
+/* put: data goes straight into the mapping, metadata is written here
+   in one go after all data blocks are in place; blocks of replaced
+   files stay busy until then, so new data never lands in them */
 void unmount()
 {
 	if (disk) {
-		free(disk->data);
+		if (disk->dirty != null) {
+			int b;
+			for (b = 0; b < disk->freed_no; b++)
+				b_free(disk->freed[b]);
+			free(disk->freed);
+			disk->freed = null;
+			disk->freed_no = 0;
+			for (b = 0; b < disk->b_lim; b++) {
+				if (disk->dirty[b] != null) {
+					memcpy(disk->data + (long long)b * 4096, disk->dirty[b], 4096);
+					free(disk->dirty[b]);
+				}
+			}
+			free(disk->dirty);
+			disk->dirty = null;
+			if (disk->dirty_no > 0)
+				printf("%d metadata blocks updated\n", disk->dirty_no);
+		}
+		if (disk->writable) w_sync_map(disk->data, disk->size);
+		w_unmap_file(disk->data, disk->size);
+		disk->data = null;
 		disk = null;
 	}
 }
 
+/* metadata block for writing: private copy until unmount() */
+static char* xdisk_dirty(int b, int zero)
+{
+	assert((disk->dirty != null && b >= 0 && b < disk->b_lim));
+	if (disk->dirty[b] == null) {
+		disk->dirty[b] = malloc(4096);
+		if (disk->dirty[b] == null) {
+			printf("not enough memory\n");
+			exit(1);
+		}
+		if (!zero) memcpy(disk->dirty[b], disk->data + (long long)b * 4096, 4096);
+		disk->dirty_no++;
+	}
+	if (zero) memset(disk->dirty[b], 0, 4096);
+	return disk->dirty[b];
+}
+
+/* data block for writing: the mapping itself */
+static char* xdisk_data(int b)
+{
+	assert((disk->writable && b > disk->ino_hi && b < disk->b_lim));
+	if (disk->dirty[b] != null) { /* metadata before, should not happen: freed blocks wait for unmount() */
+		free(disk->dirty[b]);
+		disk->dirty[b] = null;
+		disk->dirty_no--;
+	}
+	return disk->data + (long long)b * 4096;
+}
+
+/* superblock words: label, blocks busy map, inodes busy map (bit set = free) */
+static int* super_word(int w, int write)
+{
+	int b = 1 + w / 1024;
+	char* block = write ? xdisk_dirty(b, 0) : xdisk_block(b);
+	return (int*)block + w % 1024;
+}
+
+static int b_alloc()
+{
+	int i = disk->sb_b;
+	int high = (disk->b_lim + 31) / 32;
+	for (; i < high; i++) {
+		int w = *super_word(LABEL + i, 0);
+		if (w == 0) continue;
+		int j;
+		for (j = 0; j < 32; j++) {
+			int k = i * 32 + j;
+			if (k >= disk->b_lim) break;
+			if ((w & (1 << j)) == 0) continue;
+			if (k <= disk->ino_hi) {
+				printf("ERROR: inode table block %d is marked free\n", k);
+				exit(1);
+			}
+			*super_word(LABEL + i, 1) &= ~(1 << j);
+			disk->sb_b = i;
+			return k;
+		}
+	}
+	printf("ERROR: no space left on volume \"%s\"\n", disk->label);
+	exit(1);
+	return -1;
+}
+
+static void b_free(int k)
+{
+	if (k <= disk->ino_hi || k >= disk->b_lim) return;
+	*super_word(LABEL + k / 32, 1) |= 1 << (k % 32);
+	if (k / 32 < disk->sb_b) disk->sb_b = k / 32;
+}
+
+void xdisk_info(xVolInfo* info)
+{
+	info->i_no = disk->i_no;
+	info->b_no = disk->b_no;
+	info->b_lim = disk->b_lim;
+	info->ino_lo = disk->ino_lo;
+	info->ino_hi = disk->ino_hi;
+}
+
+int xdisk_block_free(int b)
+{
+	assert((b >= 0 && b < disk->b_no));
+	return (*super_word(LABEL + b / 32, 0) >> (b % 32)) & 1;
+}
+
+int xdisk_inode_free(int no)
+{
+	assert((no >= 0 && no < disk->i_no));
+	return (*super_word(LABEL + (disk->b_no + 31) / 32 + no / 32, 0) >> (no % 32)) & 1;
+}
+
+int i_alloc()
+{
+	int base = LABEL + (disk->b_no + 31) / 32;
+	int i = (disk->i_no + 31) / 32 - 1;
+	for (; i >= 0; i--) {
+		int w = *super_word(base + i, 0);
+		if (w == 0) continue;
+		int j;
+		for (j = 0; j < 32; j++) {
+			if ((w & (1 << j)) != 0 && i * 32 + j < disk->i_no) {
+				*super_word(base + i, 1) &= ~(1 << j);
+				return i * 32 + j;
+			}
+		}
+	}
+	printf("ERROR: no free inodes on volume \"%s\"\n", disk->label);
+	exit(1);
+	return -1;
+}
+
+/* disk block of file block b, -1 if there is none; long files have
+   up to 8 index blocks in ref[] of 1024 block numbers each */
+int xfile_bmap(iNode inode, int b)
+{
+	if (inode->mode & i_long) {
+		int x = b / 1024;
+		if (x >= 8 || inode->ref[x] <= 0) return -1;
+		int r = inode->ref[x];
+		if (r <= disk->ino_hi || r >= disk->b_lim) return -1;
+		return ((int*)xdisk_block(r))[b % 1024];
+	}
+	return b < 8 ? inode->ref[b] : -1;
+}
+
 void xfile_open(int ino, xFile *file)
 {
 	assert((file != null));
 	assert((disk != null));
 	assert((ino >= 0 && ino < disk->i_no));
 
-	file->inode = &disk->inodes[ino];
+	file->inode = get_inode(ino);
 	file->blocks_no = (file->inode->eof + 4095) / 4096;
-	if (file->inode->mode & i_long) {
-		file->blocks = (int *) (disk->iblocks + file->inode->ref[0]);
-		if (file->blocks_no > 1024) {
-			printf("files over 4Mb are not supported yet, sorry\n");
-			exit(1);
-		}
-	}
-	else {
-		file->blocks = file->inode->ref;
-		if (file->blocks_no > 8) {
-			printf("invalid file descriptor %d\n",ino);
-			exit(1);
-		}
+	if (file->inode->eof < 0 || file->inode->eof > MAXFILE ||
+		((file->inode->mode & i_long) == 0 && file->blocks_no > 8)) {
+		printf("invalid file descriptor %d\n",ino);
+		exit(1);
 	}
 	file->data = null;
 }
@@ -129,12 +285,11 @@ void xfile_close(xFile* file)
 
 	if (file->data != null) free(file->data);
 	file->data = null;
-	file->blocks = null;
 	file->blocks_no = 0;
 	file->inode = null;
 }
 
-char* xfile_read(xFile* file) // allocate buffer, reads eof bytes and returns pointer to the buf
+char* xfile_read(xFile* file) // allocate buffer, reads eof bytes and returns pointer to the buf, for directories
 {
 	assert((file != null && file->inode != null));
 
@@ -147,8 +302,7 @@ char* xfile_read(xFile* file) // allocate buffer, reads eof bytes and returns po
 		int i = 0;
 		CBLOCK* buf = (CBLOCK*)file->data;
 		while (i < file->blocks_no) {
-			//memcpy(buf, &disk->cblocks[file->blocks[i]], sizeof(CBLOCK));
-			memcpy(buf, disk->cblocks + file->blocks[i], sizeof(CBLOCK));
+			memcpy(buf, xfile_block(file, i), sizeof(CBLOCK));
 			buf++;
 			i++;
 		}
@@ -156,13 +310,27 @@ char* xfile_read(xFile* file) // allocate buffer, reads eof bytes and returns po
 	return file->data;
 }
 
+char* xfile_block(xFile* file, int i)
+{
+	assert((file != null && file->inode != null));
+	assert((i >= 0 && i < file->blocks_no));
+	static CBLOCK hole; // never written blocks read as zeroes
+	int b = xfile_bmap(file->inode, i);
+	if (b < 0) return hole;
+	if (b <= disk->ino_hi || b >= disk->b_lim) {
+		printf("invalid block %d in file block %d\n", b, i);
+		exit(1);
+	}
+	return xdisk_block(b);
+}
+
 void xdir_open(int ino, xDir* dir)
 {
 	assert((dir != null));
 	assert((disk != null));
 	assert((ino >= 0 && ino < disk->i_no));
 
-	iNode inode = &disk->inodes[ino];
+	iNode inode = get_inode(ino);
 	if ((inode->mode & i_dir) == 0) {
 		printf("file %d is not directory", ino);
 		exit(1);
@@ -184,5 +352,236 @@ void xdir_close(xDir* dir)
 iNode get_inode(int no)
 {
 	assert(disk != null && no >= 0 && no < disk->i_no);
-	return disk->inodes + no;
-}
\ No newline at end of file
+	return (iNode)xdisk_block(disk->ino_lo + no / 64) + no % 64;
+}
+
+static iNode get_inode_rw(int no)
+{
+	assert(disk != null && no >= 0 && no < disk->i_no);
+	return (iNode)xdisk_dirty(disk->ino_lo + no / 64, 0) + no % 64;
+}
+
+/*
+* put: allocation and directory updates follow osFileSystem
+*   (b_alloc0, i_alloc0, extend_file0, make_dir, link/insert)
+*/
+
+int xname_hash(char* name)
+{
+	if (strcmp(name, "..") == 0) return 0;
+	int i = 0;
+	int h = 0;
+	while (name[i] != 0 && i < 32) {
+		unsigned char ch = name[i];
+		if (ch == ' ' || ch == '/' || ch == ':' || ch == '\\') return -1;
+		h = h + ch - 32 + i;
+		i++;
+	}
+	if (i == 0 || i > 31) return -1;
+	if (h < 0) h = -h;
+	return (h % 64 + h / 32) % 64;
+}
+
+static int new_index()
+{
+	int r = b_alloc();
+	int* rr = (int*)xdisk_dirty(r, 1);
+	memset(rr, 0xFF, 4096); // clear_ref
+	return r;
+}
+
+/* allocates file block b right after the last one, a file with
+   more than 7 blocks is long: ref[x] -> 1024 block numbers */
+static int xfile_extend(int ino, int b, int meta)
+{
+	iNode inode = get_inode_rw(ino);
+	int k;
+	if ((inode->mode & i_long) == 0 && b >= 7) { // short2long
+		int r = new_index();
+		memcpy(xdisk_dirty(r, 0), inode->ref, sizeof(inode->ref));
+		memset(inode->ref, 0xFF, sizeof(inode->ref));
+		inode->ref[0] = r;
+		inode->mode |= i_long;
+	}
+	if ((inode->mode & i_long) == 0) {
+		k = b_alloc();
+		inode->ref[b] = k;
+	}
+	else {
+		int x = b / 1024;
+		if (x >= 8) {
+			printf("ERROR: file is too large\n");
+			exit(1);
+		}
+		if (inode->ref[x] <= 0) inode->ref[x] = new_index();
+		k = b_alloc();
+		((int*)xdisk_dirty(inode->ref[x], 0))[b % 1024] = k;
+	}
+	if (meta) xdisk_dirty(k, 1);
+	return k;
+}
+
+/* released by unmount(), the old inode stays valid on disk till then */
+static void b_free_later(int k)
+{
+	if (disk->freed_no == disk->freed_max) {
+		int n = disk->freed_max == 0 ? 1024 : disk->freed_max * 2;
+		int* p = realloc(disk->freed, n * sizeof(int));
+		if (p == null) {
+			printf("not enough memory\n");
+			exit(1);
+		}
+		disk->freed = p;
+		disk->freed_max = n;
+	}
+	disk->freed[disk->freed_no++] = k;
+}
+
+static void xfile_free(int ino)
+{
+	iNode inode = get_inode_rw(ino);
+	int i, j;
+	for (i = 0; i < 8; i++) {
+		if (inode->ref[i] <= 0) continue;
+		if (inode->mode & i_long) {
+			int* rr = (int*)xdisk_block(inode->ref[i]);
+			for (j = 0; j < 1024; j++)
+				if (rr[j] > 0) b_free_later(rr[j]);
+		}
+		b_free_later(inode->ref[i]);
+	}
+	memset(inode->ref, 0xFF, sizeof(inode->ref));
+	inode->mode &= ~i_long;
+	inode->eof = 0;
+}
+
+static int new_inode(int mode, int time)
+{
+	int ino = i_alloc();
+	iNode inode = get_inode_rw(ino);
+	int gen = inode->gen;
+	memset(inode, 0, sizeof(iNodeRec));
+	memset(inode->ref, 0xFF, sizeof(inode->ref));
+	inode->mode = mode;
+	inode->cTime = time;
+	inode->wTime = time;
+	inode->gen = gen;
+	return ino;
+}
+
+int xfile_create(int time)
+{
+	return new_inode(0, time);
+}
+
+void xfile_write(int ino, char* content, int len, int wtime)
+{
+	if (len >= MAXFILE) {
+		printf("ERROR: file is too large (%d bytes)\n", len);
+		exit(1);
+	}
+	xfile_free(ino);
+	int n = (len + 4095) / 4096;
+	if (n > 7) {
+		iNode inode = get_inode_rw(ino);
+		inode->mode |= i_long;
+	}
+	int b;
+	for (b = 0; b < n; b++) {
+		int k = xfile_extend(ino, b, 0);
+		int size = len - b * 4096 < 4096 ? len - b * 4096 : 4096;
+		char* data = xdisk_data(k);
+		memcpy(data, content + b * 4096, size);
+		if (size < 4096) memset(data + size, 0, 4096 - size);
+	}
+	iNode inode = get_inode_rw(ino);
+	inode->eof = len;
+	inode->wTime = wtime;
+}
+
+int xdir_make(int parent, int time)
+{
+	int ino = new_inode(i_dir, time);
+	int k = xfile_extend(ino, 0, 1);
+	dNode dnode = (dNode)xdisk_dirty(k, 0);
+	strcpy(dnode->name, "..");
+	dnode->inode = parent;
+	dnode->kind = d_dir + d_hidden;
+	get_inode_rw(ino)->eof = 64;
+	return ino;
+}
+
+int xdir_find(int dir, char* name, int* kind)
+{
+	iNode inode = get_inode(dir);
+	int count = inode->eof / 64;
+	int i;
+	for (i = 0; i < count; i++) {
+		if (i % 64 == 0 && xfile_bmap(inode, i / 64) <= 0) {
+			i += 63;
+			continue;
+		}
+		dNode dnode = (dNode)xdisk_block(xfile_bmap(inode, i / 64)) + i % 64;
+		if ((dnode->kind & d_del) == 0 && (dnode->kind & d_entry) != 0 &&
+			strncmp(dnode->name, name, 32) == 0) {
+			if (kind != null) *kind = dnode->kind;
+			return dnode->inode;
+		}
+	}
+	return -1;
+}
+
+static void set_dnode(dNode dnode, char* name, int ino, int kind)
+{
+	memset(dnode, 0, sizeof(dNodeRec));
+	strncpy(dnode->name, name, 31);
+	dnode->inode = ino;
+	dnode->kind = kind;
+}
+
+void xdir_link(int dir, char* name, int ino, int time)
+{
+	int hash = xname_hash(name);
+	assert((hash >= 0));
+	iNode file = get_inode_rw(ino);
+	int kind = (file->mode & i_dir) ? d_dir : (file->mode & i_esc) ? d_esc : d_file;
+	file->links++;
+
+	iNode inode = get_inode_rw(dir);
+	inode->wTime = time;
+	int count = inode->eof / 64;
+	int b = 0;
+	while (count > 0) {
+		int lim = count >= 64 ? 64 : hash <= count ? count + 1 : hash + 1;
+		count -= lim;
+		int k = xfile_bmap(inode, b);
+		if (k <= 0) {
+			printf("ERROR: directory %d has a hole at block %d\n", dir, b);
+			exit(1);
+		}
+		dNode dnodes = (dNode)xdisk_block(k);
+		int i = hash;
+		do {
+			int kd = dnodes[i].kind;
+			if ((kd & d_del) != 0 || kd == 0) {
+				dnodes = (dNode)xdisk_dirty(k, 0);
+				set_dnode(&dnodes[i], name, ino, kind);
+				if (inode->eof < b * 4096 + (i + 1) * 64)
+					inode->eof = b * 4096 + (i + 1) * 64;
+				return;
+			}
+			i = i == lim - 1 ? 0 : i + 1;
+		} while (i != hash);
+		b++;
+	}
+	/* extend directory */
+	if (inode->eof % 4096 != 0) {
+		printf("ERROR: directory %d has invalid size %d\n", dir, inode->eof);
+		exit(1);
+	}
+	b = inode->eof / 4096;
+	int k = xfile_extend(dir, b, 1);
+	dNode dnodes = (dNode)xdisk_dirty(k, 0);
+	set_dnode(&dnodes[hash], name, ino, kind);
+	inode->eof += (hash + 1) * 64;
+}
@@ -13,6 +13,9 @@
 #define i_sysf 16  // {4} 
 #define i_all (i_dir + i_long + i_esc + i_sysf) // 2+4+8+16
 
+#define MAXFILE (32 * 1024 * 1024) // 8 index blocks of a long file, osFileSystem
+                                   // extend_long stops one block short of it
+
 typedef struct {
 	int ref[8];  // blocks of the file data
 	int mode;    // set of various modes
@@ -43,19 +46,20 @@ typedef struct {
 	int rfe1[2];	// not used
 } dNodeRec, *dNode;
 
-void mount(char* fname);
+void mount(char* fname, int writable); /* writable: for xdu put */
 void unmount();
 
 typedef struct {
 	iNode inode;
 	int blocks_no;
-	int* blocks;
 	char* data;
 } xFile;
 
 void xfile_open(int ino, xFile *file);
 void xfile_close(xFile* file);
 char* xfile_read(xFile* file); // allocate buffer, reads eof bytes and returns pointer to the buf
+                               // files are read block by block with xfile_block()
+char* xfile_block(xFile* file, int i); // i-th block of the file inside the volume mapping (read only)
 
 typedef struct {
 	xFile file;
@@ -68,4 +72,27 @@ void xdir_close(xDir* dir);
 
 iNode get_inode(int no);
 
+/* check */
+typedef struct {
+	int i_no;
+	int b_no;
+	int b_lim;      // blocks present in the file
+	int ino_lo;     // inode table blocks
+	int ino_hi;
+} xVolInfo;
+
+void  xdisk_info(xVolInfo* info);
+char* xdisk_block(int b);
+int   xdisk_block_free(int b);   /* bit of the blocks busy map */
+int   xdisk_inode_free(int no);  /* bit of the inodes busy map */
+int   xfile_bmap(iNode inode, int b); /* disk block of file block b, -1 if none */
+
+/* put; changed metadata is kept in memory and written by unmount() */
+int  xname_hash(char* name);             /* -1 if Excelsior does not accept the name */
+int  xdir_find(int dir, char* name, int* kind); /* inode or -1 */
+int  xdir_make(int parent, int time);    /* new directory, not linked yet */
+int  xfile_create(int time);             /* new empty file, not linked yet */
+void xfile_write(int ino, char* content, int len, int wtime);
+void xdir_link(int dir, char* name, int ino, int time);
+
 #endif
\ No newline at end of file
@@ -1,7 +1,10 @@
-#include <Windows.h>
 #include <stdio.h>
 #include "xduTime.h"
 
+#ifdef _WIN32
+
+#include <Windows.h>
+
 const unsigned long long eraDiff = (unsigned long long)140618 * 24 * 3600; // seconds between 01.01.1600 and 01.01.1986
 
 unsigned long long ktime2wtime(int ktime)
@@ -9,6 +12,22 @@ unsigned long long ktime2wtime(int ktime)
 	return (eraDiff + (ULONGLONG)ktime) * 1000 * 10000;
 }
 
+int wtime2ktime(unsigned long long wtime)
+{
+	long long t = (long long)(wtime / (1000 * 10000)) - (long long)eraDiff;
+	return t < 0 ? 0 : t > 0x7FFFFFFF ? 0x7FFFFFFF : (int)t;
+}
+
+int ktime_now()
+{
+	FILETIME ft;
+	ULARGE_INTEGER t;
+	GetSystemTimeAsFileTime(&ft);
+	t.HighPart = ft.dwHighDateTime;
+	t.LowPart = ft.dwLowDateTime;
+	return wtime2ktime(t.QuadPart);
+}
+
 void kt2wft(int ktime, FILETIME* res)
 {
 	ULARGE_INTEGER wtime;
@@ -32,3 +51,34 @@ void pKronosTime(int ktime)
 	printf("%02d.%02d.%d %02d:%02d:%02d", st.wDay, st.wMonth, st.wYear, st.wHour, st.wMinute, st.wSecond);
 }
 
+#else
+
+#include <time.h>
+
+const long long unixDiff = 504921600LL; // seconds between 01.01.1970 and 01.01.1986
+
+long long ktime2unix(int ktime)
+{
+	return unixDiff + (long long)ktime;
+}
+
+int unix2ktime(long long utime)
+{
+	long long t = utime - unixDiff;
+	return t < 0 ? 0 : t > 0x7FFFFFFF ? 0x7FFFFFFF : (int)t;
+}
+
+int ktime_now()
+{
+	return unix2ktime((long long)time(NULL));
+}
+
+void pKronosTime(int ktime)
+{
+	struct tm st;
+	time_t t = (time_t)ktime2unix(ktime);
+	gmtime_r(&t, &st);
+	printf("%02d.%02d.%d %02d:%02d:%02d", st.tm_mday, st.tm_mon + 1, st.tm_year + 1900, st.tm_hour, st.tm_min, st.tm_sec);
+}
+
+#endif
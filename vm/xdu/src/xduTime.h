@@ -4,7 +4,11 @@
 void xduTimeInit();
 
 //void kt2wst(int ktime, SYSTEMTIME* res);
-unsigned long long ktime2wtime(int ktime);
+unsigned long long ktime2wtime(int ktime); // Windows FILETIME units
+long long ktime2unix(int ktime);           // POSIX seconds
+int wtime2ktime(unsigned long long wtime);
+int unix2ktime(long long utime);
+int ktime_now();
 void pKronosTime(int ktime);
 
 
@@ -1,9 +1,13 @@
 #include "xduWIO.h"
-#include <windows.h>
-#include <winbase.h>
 #include "stdio.h"
+#include <stdlib.h>
+#include <string.h>
 #include "xduTime.h"
-  
+
+#ifdef _WIN32
+
+#include <windows.h>
+#include <winbase.h>
 
 void set_time_attrs(HANDLE file, int created, int modified)
 {
@@ -52,35 +56,6 @@ char* toUTF8(char *src, int *src_len)
 	return utf;
 }
 
-void w_copy_file(char* path, char* content, int eof, int ctime, int wtime)
-{
-	char* converted = NULL;
-
-	HANDLE file = CreateFile(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
-	if (file == INVALID_HANDLE_VALUE) {
-		printf("ERROR creating file %s: %d", path, GetLastError());
-		exit(1);
-	}
-	char* src = content;
-	int src_len = eof;
-	if (isText(path)) { 
-		converted = toUTF8(content, &src_len); 
-		src = converted;
-	}
-
-	int written = 0;
-	if (!WriteFile(file, src, src_len, &written, NULL)) {
-		printf("ERROR writing to file %s: %d\n", path, GetLastError());
-		exit(1); 
-	}
-	if (converted) { free(converted); converted = NULL; }
-	set_time_attrs(file, ctime, wtime);
-	if (!CloseHandle(file)) {
-		printf("ERROR closing % s: % d\n", path, GetLastError());
-		exit(1);
-	}
-}
-
 void w_create_dir(char* path, int ctime, int wtime)
 {
 	if (!CreateDirectory(path, NULL)) {
@@ -108,4 +83,512 @@ void init_console()
 {
 	if (!SetConsoleOutputCP(20866))
 		printf("Set Console CP error code %d\n", GetLastError());
-}
\ No newline at end of file
+}
+
+char* w_map_file(char* path, long long* size, int writable)
+{
+	HANDLE file = CreateFile(path, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+		writable ? 0 : FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		printf("ERROR opening file %s: %d\n", path, GetLastError());
+		exit(1);
+	}
+	LARGE_INTEGER fsize;
+	if (!GetFileSizeEx(file, &fsize)) {
+		printf("ERROR getting size of %s: %d\n", path, GetLastError());
+		exit(1);
+	}
+	*size = fsize.QuadPart;
+	if (fsize.QuadPart == 0) {
+		CloseHandle(file);
+		return NULL;
+	}
+	HANDLE mapping = CreateFileMapping(file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+		printf("ERROR mapping file %s: %d\n", path, GetLastError());
+		exit(1);
+	}
+	char* data = (char*)MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+	if (data == NULL) {
+		printf("ERROR mapping file %s: %d\n", path, GetLastError());
+		exit(1);
+	}
+	CloseHandle(mapping); /* the view keeps the mapping and the file open */
+	CloseHandle(file);
+	return data;
+}
+
+void w_sync_map(char* data, long long size)
+{
+	if (data != NULL && !FlushViewOfFile(data, 0)) {
+		printf("ERROR flushing volume: %d\n", GetLastError());
+		exit(1);
+	}
+}
+
+void w_unmap_file(char* data, long long size)
+{
+	if (data != NULL) UnmapViewOfFile(data);
+}
+
+static int cmp_entries(const void* a, const void* b)
+{
+	return strcmp(((wEntry*)a)->name, ((wEntry*)b)->name);
+}
+
+int w_list_dir(char* path, wEntry** list)
+{
+	char pattern[MAX_PATH];
+	WIN32_FIND_DATA fd;
+	int n = 0, max = 64;
+	if (strlen(path) + 3 >= MAX_PATH) {
+		printf("ERROR: too long path \"%s\"\n", path);
+		exit(1);
+	}
+	strcpy(pattern, path);
+	strcat(pattern, "\\*");
+	*list = malloc(max * sizeof(wEntry));
+	HANDLE h = FindFirstFile(pattern, &fd);
+	if (h == INVALID_HANDLE_VALUE) {
+		printf("ERROR reading directory %s: %d\n", path, GetLastError());
+		exit(1);
+	}
+	do {
+		if (strcmp(fd.cFileName, ".") == 0 || strcmp(fd.cFileName, "..") == 0) continue;
+		if (n == max) {
+			max *= 2;
+			*list = realloc(*list, max * sizeof(wEntry));
+		}
+		if (*list == NULL) {
+			printf("not enough memory\n");
+			exit(1);
+		}
+		wEntry* e = *list + n++;
+		strncpy(e->name, fd.cFileName, 255);
+		e->name[255] = 0;
+		e->dir = (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+		ULARGE_INTEGER t;
+		t.HighPart = fd.ftLastWriteTime.dwHighDateTime;
+		t.LowPart = fd.ftLastWriteTime.dwLowDateTime;
+		e->mtime = wtime2ktime(t.QuadPart);
+	} while (FindNextFile(h, &fd));
+	FindClose(h);
+	qsort(*list, n, sizeof(wEntry), cmp_entries);
+	return n;
+}
+
+char* fromUTF8(char* src, int* src_len)
+{
+	int wchar_len = MultiByteToWideChar(CP_UTF8, 0, src, *src_len, NULL, 0);
+	wchar_t* wideString = malloc(sizeof(wchar_t) * (wchar_len + 1));
+	MultiByteToWideChar(CP_UTF8, 0, src, *src_len, wideString, wchar_len);
+
+	int koi_len = WideCharToMultiByte(20866, 0, wideString, wchar_len, NULL, 0, NULL, NULL);
+	char* koi = malloc(koi_len + 1);
+	WideCharToMultiByte(20866, 0, wideString, wchar_len, koi, koi_len, NULL, NULL);
+	free(wideString);
+
+	int i, j = 0;
+	for (i = 0; i < koi_len; i++) {
+		if (koi[i] == 0x0d && i + 1 < koi_len && koi[i + 1] == 0x0a) continue;
+		koi[j++] = koi[i] == 0x0a ? 0x1e : koi[i];
+	}
+	koi[j] = 0;
+	*src_len = j;
+	return koi;
+}
+
+wFile w_create(char* path)
+{
+	HANDLE file = CreateFile(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		printf("ERROR creating file %s: %d\n", path, GetLastError());
+		exit(1);
+	}
+	return (wFile)file;
+}
+
+void w_write(wFile file, char* path, wExtent* ext, int n)
+{
+	while (n--) {
+		DWORD written = 0;
+		if (!WriteFile((HANDLE)file, ext->data, ext->len, &written, NULL) || written != (DWORD)ext->len) {
+			printf("ERROR writing to file %s: %d\n", path, GetLastError());
+			exit(1);
+		}
+		ext++;
+	}
+}
+
+void w_close(wFile file, char* path, int ctime, int wtime)
+{
+	set_time_attrs((HANDLE)file, ctime, wtime);
+	if (!CloseHandle((HANDLE)file)) {
+		printf("ERROR closing %s: %d\n", path, GetLastError());
+		exit(1);
+	}
+}
+
+int w_cpu_count()
+{
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	return si.dwNumberOfProcessors > 0 ? si.dwNumberOfProcessors : 1;
+}
+
+typedef struct {
+	void (*worker)(void* arg, int no);
+	void* arg;
+	int no;
+} wThread;
+
+static DWORD WINAPI w_thread(LPVOID param)
+{
+	wThread* t = (wThread*)param;
+	t->worker(t->arg, t->no);
+	return 0;
+}
+
+void w_parallel(int threads, void (*worker)(void* arg, int no), void* arg)
+{
+	wThread t[W_MAX_THREADS];
+	HANDLE h[W_MAX_THREADS];
+	if (threads > W_MAX_THREADS) threads = W_MAX_THREADS;
+	int i;
+	for (i = 0; i < threads; i++) {
+		t[i].worker = worker; t[i].arg = arg; t[i].no = i;
+		h[i] = CreateThread(NULL, 0, w_thread, &t[i], 0, NULL);
+		if (h[i] == NULL) {
+			printf("ERROR creating thread: %d\n", GetLastError());
+			exit(1);
+		}
+	}
+	WaitForMultipleObjects(threads, h, TRUE, INFINITE);
+	for (i = 0; i < threads; i++) CloseHandle(h[i]);
+}
+
+long w_atomic_inc(volatile long* counter)
+{
+	return InterlockedIncrement(counter);
+}
+
+int w_atomic_bts(volatile long* word, int bit)
+{
+	return InterlockedBitTestAndSet(word, bit) != 0;
+}
+
+unsigned w_msec()
+{
+	return GetTickCount();
+}
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <iconv.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* POSIX: no creation time, access and modification time are set to modified */
+void set_time_attrs(char* path, int created, int modified)
+{
+	struct timespec ts[2];
+	(void)created;
+	ts[0].tv_sec = (time_t)ktime2unix(modified);
+	ts[0].tv_nsec = 0;
+	ts[1] = ts[0];
+	if (utimensat(AT_FDCWD, path, ts, 0) != 0) {
+		perror("\nERROR: can't set time");
+	}
+}
+
+int isText(char* fname)
+{
+	int len = strlen(fname);
+	char* c = fname + len;
+	do { len--; c--; } while (len && *c != '.');
+	return ((len != 0) && ((strcmp(c, ".m") == 0) || (strcmp(c, ".d") == 0)));
+}
+
+char* toUTF8(char *src, int *src_len)
+{
+	int i = *src_len;
+	char* c = src;
+	while (i) {
+		if (*c == 0x1e) *c = 0x0a;
+		c++; i--;
+	}
+
+	iconv_t cd = iconv_open("UTF-8", "KOI8-R");
+	if (cd == (iconv_t)-1) {
+		perror("iconv_open KOI8-R");
+		exit(1);
+	}
+	size_t in_left = *src_len;
+	size_t out_left = (size_t)*src_len * 3; /* KOI8-R needs 3 UTF-8 bytes at most */
+	char* utf = malloc(out_left + 1);
+	if (utf == NULL) {
+		printf("not enough memory\n");
+		exit(1);
+	}
+	char* in = src;
+	char* out = utf;
+	if (iconv(cd, &in, &in_left, &out, &out_left) == (size_t)-1) {
+		perror("iconv");
+		exit(1);
+	}
+	iconv_close(cd);
+	*out = 0;
+	*src_len = out - utf;
+	return utf;
+}
+
+void w_create_dir(char* path, int ctime, int wtime)
+{
+	(void)ctime; (void)wtime;
+	if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+		printf("Can not create directory \"%s\"  error %s\n", path, strerror(errno));
+		exit(1);
+	}
+}
+
+void init_console()
+{
+}
+
+char* w_map_file(char* path, long long* size, int writable)
+{
+	int file = open(path, writable ? O_RDWR : O_RDONLY);
+	if (file < 0) {
+		perror("file open");
+		exit(1);
+	}
+	struct stat st;
+	if (fstat(file, &st) != 0) {
+		perror("STAT ERROR");
+		exit(1);
+	}
+	*size = st.st_size;
+	if (st.st_size == 0) {
+		close(file);
+		return NULL;
+	}
+	char* data = mmap(NULL, st.st_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, file, 0);
+	if (data == MAP_FAILED) {
+		perror("MMAP ERROR");
+		exit(1);
+	}
+	close(file); /* the mapping stays valid */
+	return data;
+}
+
+void w_sync_map(char* data, long long size)
+{
+	if (data != NULL && msync(data, (size_t)size, MS_SYNC) != 0) {
+		perror("MSYNC ERROR");
+		exit(1);
+	}
+}
+
+void w_unmap_file(char* data, long long size)
+{
+	if (data != NULL) munmap(data, (size_t)size);
+}
+
+static int cmp_entries(const void* a, const void* b)
+{
+	return strcmp(((wEntry*)a)->name, ((wEntry*)b)->name);
+}
+
+int w_list_dir(char* path, wEntry** list)
+{
+	int n = 0, max = 64;
+	DIR* dir = opendir(path);
+	if (dir == NULL) {
+		printf("ERROR reading directory %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+	*list = malloc(max * sizeof(wEntry));
+	struct dirent* de;
+	while ((de = readdir(dir)) != NULL) {
+		if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+		char full[4096];
+		struct stat st;
+		snprintf(full, sizeof(full), "%s/%s", path, de->d_name);
+		if (stat(full, &st) != 0) {
+			printf("ERROR: can't stat %s: %s\n", full, strerror(errno));
+			continue;
+		}
+		if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode)) continue;
+		if (n == max) {
+			max *= 2;
+			*list = realloc(*list, max * sizeof(wEntry));
+		}
+		if (*list == NULL) {
+			printf("not enough memory\n");
+			exit(1);
+		}
+		wEntry* e = *list + n++;
+		strncpy(e->name, de->d_name, 255);
+		e->name[255] = 0;
+		e->dir = S_ISDIR(st.st_mode);
+		e->mtime = unix2ktime((long long)st.st_mtime);
+	}
+	closedir(dir);
+	qsort(*list, n, sizeof(wEntry), cmp_entries);
+	return n;
+}
+
+char* fromUTF8(char* src, int* src_len)
+{
+	iconv_t cd = iconv_open("KOI8-R", "UTF-8");
+	if (cd == (iconv_t)-1) {
+		perror("iconv_open KOI8-R");
+		exit(1);
+	}
+	size_t in_left = *src_len;
+	size_t out_left = *src_len; /* never longer than UTF-8 */
+	char* koi = malloc(out_left + 1);
+	if (koi == NULL) {
+		printf("not enough memory\n");
+		exit(1);
+	}
+	char* in = src;
+	char* out = koi;
+	while (in_left > 0 && iconv(cd, &in, &in_left, &out, &out_left) == (size_t)-1) {
+		if (errno != EILSEQ && errno != EINVAL) {
+			perror("iconv");
+			exit(1);
+		}
+		*out++ = '?'; out_left--; /* no KOI-8 for it, skip the UTF-8 sequence */
+		do { in++; in_left--; } while (in_left > 0 && (*in & 0xC0) == 0x80);
+	}
+	iconv_close(cd);
+
+	int len = out - koi;
+	int i, j = 0;
+	for (i = 0; i < len; i++) {
+		if (koi[i] == 0x0d && i + 1 < len && koi[i + 1] == 0x0a) continue;
+		koi[j++] = koi[i] == 0x0a ? 0x1e : koi[i];
+	}
+	koi[j] = 0;
+	*src_len = j;
+	return koi;
+}
+
+
+#ifndef IOV_MAX
+#define IOV_MAX 16
+#endif
+
+wFile w_create(char* path)
+{
+	int file = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (file < 0) {
+		printf("ERROR creating file %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+	return (wFile)(long)file;
+}
+
+void w_write(wFile file, char* path, wExtent* ext, int n)
+{
+	struct iovec iov[64];
+	while (n > 0) {
+		int k = 0;
+		while (k < n && k < 64 && k < IOV_MAX) {
+			iov[k].iov_base = ext[k].data;
+			iov[k].iov_len = ext[k].len;
+			k++;
+		}
+		int i = 0;
+		while (i < k) { /* writev may stop short, resume inside the extent */
+			ssize_t written = writev((int)(long)file, iov + i, k - i);
+			if (written < 0) {
+				printf("ERROR writing to file %s: %s\n", path, strerror(errno));
+				exit(1);
+			}
+			while (i < k && written >= (ssize_t)iov[i].iov_len) {
+				written -= iov[i].iov_len;
+				i++;
+			}
+			if (i < k) {
+				iov[i].iov_base = (char*)iov[i].iov_base + written;
+				iov[i].iov_len -= written;
+			}
+		}
+		ext += k;
+		n -= k;
+	}
+}
+
+void w_close(wFile file, char* path, int ctime, int wtime)
+{
+	if (close((int)(long)file) != 0) {
+		printf("ERROR closing %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+	set_time_attrs(path, ctime, wtime);
+}
+
+int w_cpu_count()
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+}
+
+typedef struct {
+	void (*worker)(void* arg, int no);
+	void* arg;
+	int no;
+} wThread;
+
+static void* w_thread(void* param)
+{
+	wThread* t = (wThread*)param;
+	t->worker(t->arg, t->no);
+	return NULL;
+}
+
+void w_parallel(int threads, void (*worker)(void* arg, int no), void* arg)
+{
+	wThread t[W_MAX_THREADS];
+	pthread_t h[W_MAX_THREADS];
+	if (threads > W_MAX_THREADS) threads = W_MAX_THREADS;
+	int i;
+	for (i = 0; i < threads; i++) {
+		t[i].worker = worker; t[i].arg = arg; t[i].no = i;
+		if (pthread_create(&h[i], NULL, w_thread, &t[i]) != 0) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for (i = 0; i < threads; i++) pthread_join(h[i], NULL);
+}
+
+long w_atomic_inc(volatile long* counter)
+{
+	return __sync_add_and_fetch(counter, 1);
+}
+
+int w_atomic_bts(volatile long* word, int bit)
+{
+	long mask = 1L << bit;
+	return (__sync_fetch_and_or(word, mask) & mask) != 0;
+}
+
+unsigned w_msec()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+#endif
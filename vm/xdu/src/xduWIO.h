@@ -1,9 +1,45 @@
 #ifndef XDUWIO_INCLUDED
 #define XDUWIO_INCLUDED
 
-void w_copy_file(char* path, char* content, int eof, int ctime, int wtime);
+int isText(char* fname); /* .m and .d files are KOI-8 texts */
+char* toUTF8(char* src, int* src_len);     /* replaces 0x1e in src, free() the result */
 void w_create_dir(char* path, int ctime, int wtime);
 
-void initConsole();
+/* file content as pieces of the mapped volume, written without copying */
+typedef struct {
+	char* data;
+	int len;
+} wExtent;
+
+typedef void* wFile;
+
+wFile w_create(char* path);
+void w_write(wFile file, char* path, wExtent* ext, int n);
+void w_close(wFile file, char* path, int ctime, int wtime); /* sets the times */
+
+void init_console();
+
+/* mapping of the whole file, NULL if it is empty */
+char* w_map_file(char* path, long long* size, int writable);
+void w_sync_map(char* data, long long size);
+void w_unmap_file(char* data, long long size);
+
+/* host directory entries sorted by name, without "." and ".." */
+typedef struct {
+	char name[256];
+	int dir;
+	int mtime;  /* Kronos time */
+} wEntry;
+
+int w_list_dir(char* path, wEntry** list); /* returns number of entries, free(*list) */
+char* fromUTF8(char* src, int* src_len);   /* KOI-8 with 0x1e line separators, free() it */
+
+/* runs worker(arg, 0..threads-1) on its own threads and waits for all */
+#define W_MAX_THREADS 64
+int  w_cpu_count();
+void w_parallel(int threads, void (*worker)(void* arg, int no), void* arg);
+long w_atomic_inc(volatile long* counter); /* returns the new value */
+int  w_atomic_bts(volatile long* word, int bit); /* sets the bit, returns its old value */
+unsigned w_msec();                          /* monotonic milliseconds */
 
 #endif
\ No newline at end of file